@@ -8,8 +8,8 @@
 
 def generator(n, text = ''):
 	if (len(text) > 0):
-		code = 'Variable("c' + text + 'r", [](const Variable& args, Environment& env)->Variable{\n'
-		code += '\treturn FIRST_ARG(args)'
+		code = 'Variable("c' + text + 'r", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{\n'
+		code += '\treturn FIRST_ARG(argv)'
 		for i in text:
 			code += '.c' + i + 'r()'
 		code += ';\n'
@@ -0,0 +1,43 @@
+#!/usr/bin/python3
+
+#
+# Parallel mark benchmark, main should be built with -DSTATS
+#
+# Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
+#
+import os
+import re
+import sys
+import subprocess
+
+# Config
+EXECUTE		= '../bin/main'
+THREADS		= [1, 2, 4, 8]
+LISTS		= 1000			# Count of lists kept alive
+LENGTH		= 1000			# Length of each list
+ROUNDS		= 4				# Count of heaps allocated and dropped to trigger full collection
+
+# Heap of large lists kept alive, garbage heaps survive minor collections and grow old generation
+PROGRAM = '''
+(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))
+(define (heap n acc) (if (= n 0) acc (heap (- n 1) (cons (build {length} '()) acc))))
+(define live (heap {lists} '()))
+'''.format(length = LENGTH, lists = LISTS) + '''
+(define garbage (heap {lists} '()))
+(define garbage 0)
+'''.format(lists = LISTS) * ROUNDS
+
+def benchmark(threads):
+	result = subprocess.run([EXECUTE, '--gc-threads', str(threads)], input = PROGRAM,
+		stdout = subprocess.DEVNULL, stderr = subprocess.PIPE, universal_newlines = True)
+	times = re.findall(r'full mark \(ns\)\s+([0-9.e+-]+) per variable', result.stderr)
+	if not times:
+		sys.exit('no statistic found, is main built with -DSTATS?')
+	return float(times[-1])
+
+base = None
+for threads in THREADS:
+	time = benchmark(threads)
+	base = base or time
+	print('{:d} threads\t{:.2f} ns per variable\t{:.1f}M variables/s\t{:.2f}x'.format(
+		threads, time, 1e3 / time, base / time))
@@ -0,0 +1,54 @@
+#!/usr/bin/python3
+
+#
+# Reader benchmark, data is read by read primitive without evaluation
+#
+# Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
+#
+import os
+import time
+import tempfile
+import subprocess
+
+# Config
+EXECUTE		= '../bin/main'
+RECORDS		= 100000		# Count of records in data
+ROUNDS		= 3				# Count of runs, the fastest is reported
+
+# Program reading datums until end of file
+PROGRAM = '''
+(define (loop) (read) (loop))
+(loop)
+'''
+
+# Record of nested lists, numbers, strings and comments
+RECORD = '''; record {index}
+(record {index} "name-{index}" (point {index}.5 -{index}/3)
+  (tags alpha beta gamma) (nested (a (b (c . d)))) '(quoted {index}))
+'''
+
+def benchmark(program, data):
+	best = None
+	for _ in range(ROUNDS):
+		with open(data) as fin:
+			start = time.time()
+			subprocess.run([EXECUTE, program], stdin = fin,
+				stdout = subprocess.DEVNULL, stderr = subprocess.DEVNULL)
+			elapsed = time.time() - start
+		best = elapsed if best is None else min(best, elapsed)
+	return best
+
+with tempfile.TemporaryDirectory() as directory:
+	program = os.path.join(directory, 'read.scm')
+	data = os.path.join(directory, 'data.scm')
+	empty = os.path.join(directory, 'empty.scm')
+	with open(program, 'w') as fout:
+		fout.write(PROGRAM)
+	with open(data, 'w') as fout:
+		for i in range(RECORDS):
+			fout.write(RECORD.format(index = i))
+	open(empty, 'w').close()
+	size = os.path.getsize(data) / 1e6
+	# Startup time is measured with empty data and subtracted
+	elapsed = benchmark(program, data) - benchmark(program, empty)
+	print('{:.1f} MB in {:.3f}s\t{:.1f} MB/s'.format(size, elapsed, size / elapsed))
@@ -3,21 +3,143 @@
 // 
 // Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
 //
+#include <map>
+#include <deque>
+#include <new>
 #include "environment.hpp"
 #include "variable.hpp"
 
+// Cell of global variable
+struct Environment::Cell
+{
+	Variable value;		// Value of variable
+	bool bound;			// Is defined?
+	Cell(): value(VAR_VOID), bound(false) {}
+};
+
+// Frame of variables, slots follow header in the same block
+struct Environment::Frame
+{
+	int refCount;						// Count of handles
+	int gcTag;							// Epoch of GC marked
+	Frame* encloseFrame;				// Enclosing frame, null for top-environment
+	shared_ptr<const Layout> layout;	// Symbol IDs of slots
+	std::map<int, Variable>* names;		// Variables defined at runtime, allocated on demand
+	std::deque<Cell>* globals;			// Globals indexed by symbol ID, null except top-environment
+	int size;							// Count of slots
+	int gcRefs;							// References from outside of collected values
+	bool counted;						// Are references counted by collector?
+	bool young;							// Created since last collection?
+
+	// Get slots
+	Variable* slots() { return reinterpret_cast<Variable*>(this + 1); }
+
+	// Allocate frame with slots uninitialized
+	static Frame* create(const shared_ptr<const Layout>& layout, Frame* encloseFrame)
+	{
+		int size = layout ? layout->size() : 0;
+		void* block = ::operator new(sizeof(Frame) + size * sizeof(Variable));
+		Frame* frame = new (block) Frame{1, 0, encloseFrame, layout, nullptr, nullptr, size, 0, false, true};
+		GarbageCollector::allocate(sizeof(Frame) + size * sizeof(Variable));
+		if (encloseFrame)
+			encloseFrame->refCount++;
+		return frame;
+	}
+
+	// Release handle, destroy frames without handle
+	static void release(Frame* frame)
+	{
+		while (frame && --frame->refCount == 0) {
+			Frame* encloseFrame = frame->encloseFrame;
+			Variable* slots = frame->slots();
+			for (int i = 0; i < frame->size; i++)
+				slots[i].~Variable();
+			delete frame->names;
+			delete frame->globals;
+			frame->~Frame();
+			::operator delete(frame);
+			frame = encloseFrame;
+		}
+	}
+};
+
+// Constructor for handle of frame
+Environment::Environment(Frame *framePtr): framePtr(framePtr)
+{
+	if (framePtr)
+		framePtr->refCount++;
+}
+
 // Constructor for top-environment
-Environment::Environment(const Variable &vars, const Variable &vals): 
-		encloseEnvPtr(nullptr), framePtr(std::make_shared<frame>())
+Environment::Environment(const Variable &vars, const Variable &vals):
+		framePtr(Frame::create(nullptr, nullptr))
 {
+	framePtr->globals = new std::deque<Cell>();
+	framePtr->young = false;
 	addVars(vars, vals);
 }
 
-// Constructor for sub-environment
-Environment::Environment(const Variable &vars, const Variable &vals, const Environment &encloseEnv): 
-		encloseEnvPtr(std::make_shared<Environment>(encloseEnv)), framePtr(std::make_shared<frame>())
+// Constructor for sub-environment, slots are void
+Environment::Environment(const shared_ptr<const Layout> &layout, const Environment &encloseEnv):
+		framePtr(Frame::create(layout, encloseEnv.framePtr))
 {
-	addVars(vars, vals);
+	Variable* slots = framePtr->slots();
+	for (int i = 0; i < framePtr->size; i++)
+		new (&slots[i]) Variable(VAR_VOID);
+}
+
+// Constructor for sub-environment binding values to the first slots
+Environment::Environment(const shared_ptr<const Layout> &layout, Variable *vals, int count, const Environment &encloseEnv):
+		framePtr(Frame::create(layout, encloseEnv.framePtr))
+{
+	Variable* slots = framePtr->slots();
+	for (int i = 0; i < framePtr->size; i++)
+		if (i < count)
+			new (&slots[i]) Variable(std::move(vals[i]));
+		else
+			new (&slots[i]) Variable(VAR_VOID);
+}
+
+// Copy and move
+Environment::Environment(const Environment &env): framePtr(env.framePtr)
+{
+	if (framePtr)
+		framePtr->refCount++;
+}
+
+Environment::Environment(Environment &&env) noexcept: framePtr(env.framePtr)
+{
+	env.framePtr = nullptr;
+}
+
+Environment& Environment::operator=(Environment env)
+{
+	std::swap(framePtr, env.framePtr);
+	return *this;
+}
+
+Environment::~Environment()
+{
+	Frame::release(framePtr);
+}
+
+// Is top-environment?
+bool Environment::isGlobal() const
+{
+	return !framePtr->encloseFrame;
+}
+
+// Get enclosing environment
+Environment Environment::getEncloseEnv() const
+{
+	return Environment(framePtr->encloseFrame);
+}
+
+// Get layout of frame
+const Environment::Layout& Environment::getLayout() const
+{
+	static const Layout empty;
+	return framePtr->layout ? *framePtr->layout : empty;
 }
 
 // Add variables into environment
@@ -27,42 +149,101 @@ void Environment::addVars(const Variable &vars, const Variable &vals)
 		Variable var = varIt.car();
 		Variable val = valIt.car();
 		var.requireType("define variable", Variable::TYPE_SYMBOL);
-		(*framePtr)[var.toString()] = val;
+		defineVariable(var, val);
 	}
 }
 
+// Get frame at depth, or the outermost frame if depth is negative
+Environment::Frame* Environment::frameAt(int depth) const
+{
+	Frame* frame = framePtr;
+	if (depth < 0) {
+		while (frame->encloseFrame)
+			frame = frame->encloseFrame;
+	} else {
+		while (depth-- > 0)
+			frame = frame->encloseFrame;
+	}
+	return frame;
+}
+
+// Find variable in frame, null if not found
+Variable* Environment::findLocalVar(Frame *frame, const Variable &var)
+{
+	int id = var.getSymbolId();
+	if (frame->layout) {
+		const Layout& layout = *frame->layout;
+		for (size_t i = 0; i < layout.size(); i++)
+			if (layout[i] == id)
+				return &frame->slots()[i];
+	}
+	if (frame->globals) {
+		std::deque<Cell>& globals = *frame->globals;
+		return (size_t) id < globals.size() && globals[id].bound ? &globals[id].value : nullptr;
+	}
+	if (!frame->names)
+		return nullptr;
+	auto it = frame->names->find(id);
+	return it != frame->names->end() ? &it->second : nullptr;
+}
+
 // Find variable in environment
-Environment::frame::iterator Environment::findVar(const string &var)
+Variable* Environment::findVar(const Variable &var) const
 {
 	// Find variable from inner env to outer env
-	for (Environment *envIt = this; envIt; envIt = envIt->encloseEnvPtr.get()) {
-		auto it = envIt->framePtr->find(var);
-		if (it != envIt->framePtr->cend())
-			return it;
+	for (Frame* frame = framePtr; frame; frame = frame->encloseFrame) {
+		Variable* slot = findLocalVar(frame, var);
+		if (slot)
+			return slot;
 	}
 	// Variable not found
-	throw Exception(var + ": variable not found");
+	throw Exception(var.toString() + ": variable not found");
 }
 
 // Define variable
-Variable Environment::defineVariable(const Variable& var, const Variable& val)
+Variable Environment::defineVariable(const Variable& var, Variable val)
 {
 	var.requireType("define", Variable::TYPE_SYMBOL);
-	return defineVariable(var.toString(), val);
+	Variable* slot = findLocalVar(framePtr, var);
+	if (slot) {
+		GarbageCollector::writeBarrier(*slot);
+		*slot = std::move(val);
+	} else if (framePtr->globals) {
+		// Optimization: cells never move, cached cells stay valid
+		std::deque<Cell>& globals = *framePtr->globals;
+		size_t id = var.getSymbolId();
+		if (id >= globals.size())
+			globals.resize(id + 1);
+		globals[id].value = std::move(val);
+		globals[id].bound = true;
+	} else {
+		if (!framePtr->names)
+			framePtr->names = new std::map<int, Variable>();
+		(*framePtr->names)[var.getSymbolId()] = std::move(val);
+	}
+	return VAR_VOID;
 }
 
-Variable Environment::defineVariable(const string& var, const Variable& val)
+Variable Environment::defineVariable(const string& var, Variable val)
 {
-	(*framePtr)[var] = val;
-	return VAR_VOID;
+	return defineVariable(Variable::createSymbol(var), std::move(val));
 }
 
 // Assign variable
-Variable Environment::assignVariable(const Variable &var, const Variable &val)
+Variable Environment::assignVariable(const Variable &var, Variable val)
 {
 	var.requireType("set!", Variable::TYPE_SYMBOL);
-	auto it = findVar(var.toString());
-	it->second = val;
+	Variable* slot = findVar(var);
+	GarbageCollector::writeBarrier(*slot);
+	*slot = std::move(val);
+	return VAR_VOID;
+}
+
+Variable Environment::assignVariable(int depth, int slot, Variable val)
+{
+	Variable& var = frameAt(depth)->slots()[slot];
+	GarbageCollector::writeBarrier(var);
+	var = std::move(val);
 	return VAR_VOID;
 }
 
@@ -70,21 +251,126 @@ Variable Environment::assignVariable(const Variable &var, const Variable &val)
 Variable Environment::lookupVariable(const Variable &var)
 {
 	var.requireType("lookup variable", Variable::TYPE_SYMBOL);
-	auto it = findVar(var.toString());
-	return it->second;
+	return *findVar(var);
+}
+
+const Variable& Environment::lookupVariable(int depth, int slot) const
+{
+	return frameAt(depth)->slots()[slot];
+}
+
+// Find cell of defined global variable, null if not defined
+Variable* Environment::findGlobal(const Variable &var) const
+{
+	return findLocalVar(frameAt(-1), var);
+}
+
+// Check whether environment has been tagged
+bool Environment::isTagged(int tag) const
+{
+	return !framePtr || __atomic_load_n(&framePtr->gcTag, __ATOMIC_RELAXED) == tag;
 }
 
 // Finalize values
 void Environment::finalize() const
 {
-	framePtr->clear();
+	Variable* slots = framePtr->slots();
+	for (int i = 0; i < framePtr->size; i++)
+		slots[i] = VAR_VOID;
+	if (framePtr->names)
+		framePtr->names->clear();
+	if (framePtr->globals)
+		for (Cell& cell : *framePtr->globals)
+			cell.value = VAR_VOID;
+}
+
+// Scan and tag values in using, frame is tagged atomically so that only one marker scans it
+void Environment::scan(int tag, GarbageCollector::MarkStack& stack) const
+{
+	for (Frame* frame = framePtr; frame && __atomic_exchange_n(&frame->gcTag, tag, __ATOMIC_RELAXED) != tag;
+		frame = frame->encloseFrame) {
+		frame->young = false;
+		Variable* slots = frame->slots();
+		for (int i = 0; i < frame->size; i++)
+			if (!slots[i].isTagged(tag))
+				stack.push_back(&slots[i]);
+		if (frame->names)
+			for (const auto& it : *frame->names)
+				if (!it.second.isTagged(tag))
+					stack.push_back(&it.second);
+		if (frame->globals)
+			for (const Cell& cell : *frame->globals)
+				if (!cell.value.isTagged(tag))
+					stack.push_back(&cell.value);
+	}
 }
 
-// Scan and tag values in using
-void Environment::scan(int tag) const
+// Scan and promote young frames in using, old frames aren't traversed
+void Environment::scanYoung(GarbageCollector::MarkStack& stack) const
 {
-	*gcTag = tag;
-	for (auto it : *framePtr)
-		if (*it.second.gcTag != tag)
-			it.second.scan(tag);
-}
\ No newline at end of file
+	for (Frame* frame = framePtr; frame && frame->young; frame = frame->encloseFrame) {
+		frame->young = false;
+		Variable* slots = frame->slots();
+		for (int i = 0; i < frame->size; i++)
+			if (slots[i].isYoung())
+				stack.push_back(&slots[i]);
+		if (frame->names)
+			for (const auto& it : *frame->names)
+				if (it.second.isYoung())
+					stack.push_back(&it.second);
+		if (frame->globals)
+			for (const Cell& cell : *frame->globals)
+				if (cell.value.isYoung())
+					stack.push_back(&cell.value);
+	}
+}
+
+// Count references to frames from outside, young frames only if young
+void Environment::countRefs(std::vector<Environment> &frames, bool young) const
+{
+	for (Frame* frame = framePtr; frame && !frame->counted && (!young || frame->young); frame = frame->encloseFrame) {
+		frame->counted = true;
+		frames.push_back(Environment(frame));
+		// Reference from list of collector isn't counted
+		frame->gcRefs = frame->refCount - 1;
+	}
+}
+
+// Discount references from frame to collected values
+void Environment::discountRefs(bool young) const
+{
+	Variable* slots = framePtr->slots();
+	for (int i = 0; i < framePtr->size; i++)
+		slots[i].discount(young);
+	if (framePtr->names)
+		for (const auto& it : *framePtr->names)
+			it.second.discount(young);
+	if (framePtr->globals)
+		for (const Cell& cell : *framePtr->globals)
+			cell.value.discount(young);
+	Environment::discount(framePtr->encloseFrame);
+}
+
+// Discount a reference to frame if collected
+void Environment::discount(Frame *frame)
+{
+	if (frame && frame->counted)
+		frame->gcRefs--;
+}
+
+void Environment::discount(bool young) const
+{
+	discount(framePtr);
+}
+
+// Check whether frame is referenced from outside of collected values
+bool Environment::isRoot() const
+{
+	return framePtr->gcRefs > 0;
+}
+
+// Reset frame after references counted
+void Environment::resetRefs() const
+{
+	framePtr->counted = false;
+}
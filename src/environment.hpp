@@ -5,7 +5,7 @@
 //
 #pragma once
 
-#include <map>
+#include <vector>
 #include <string>
 #include <memory>
 #include "garbage.hpp"
@@ -19,46 +19,113 @@ extern const Variable VAR_VOID;
 extern const Variable VAR_TRUE;
 extern const Variable VAR_FALSE;
 
-class Environment: public GarbageObject
+// Optimization: handle is a bare pointer to frame, collector calls it by concrete type so no vtable is carried
+class Environment
 {
+public:
+
+	// Symbol IDs of slots in frame, resolved at analysis
+	using Layout = std::vector<int>;
+
+private:
+
 	// Type alias
 	using string = std::string;
-	using frame = std::map<string, Variable>;
 	template <typename T> using shared_ptr = std::shared_ptr<T>;
 
-	// Data member
-	shared_ptr<Environment> encloseEnvPtr;
-	shared_ptr<frame> framePtr;
+	// Frame of variables, slots in layout, globals in table or others by name
+	struct Frame;
+
+	// Cell of global variable
+	struct Cell;
+
+	// Optimization: frame and its slots are allocated in one block, shared by handles
+	Frame* framePtr;
 
 	friend class Variable;
 
+	// Constructor for handle of frame
+	explicit Environment(Frame* framePtr);
+
 	// Add variables
 	void addVars(const Variable& vars, const Variable& vals);
 
-	// Find variable
-	frame::iterator findVar(const string& var);
+	// Find variable by name
+	static Variable* findLocalVar(Frame* frame, const Variable& var);
+	Variable* findVar(const Variable& var) const;
+
+	// Get frame at depth
+	Frame* frameAt(int depth) const;
+
+	// Discount a reference to frame if collected
+	static void discount(Frame* frame);
+	void discount(bool young) const;
 
 public:
-	
+
+	// Constructor for empty environment
+	Environment(): framePtr(nullptr) {}
+
 	// Constructor for top-environment
-	Environment(const Variable& vars = VAR_NULL, const Variable& vals = VAR_NULL);
+	Environment(const Variable& vars, const Variable& vals);
+
+	// Constructor for sub-environment, slots are void
+	Environment(const shared_ptr<const Layout>& layout, const Environment& encloseEnv);
 
-	// Constructor for sub-environment
-	Environment(const Variable& vars, const Variable& vals, const Environment& encloseEnv);
+	// Constructor for sub-environment binding values to the first slots
+	Environment(const shared_ptr<const Layout>& layout, Variable* vals, int count, const Environment& encloseEnv);
+
+	// Copy and move
+	Environment(const Environment& env);
+	Environment(Environment&& env) noexcept;
+	Environment& operator=(Environment env);
+	~Environment();
+
+	// Is top-environment?
+	bool isGlobal() const;
+
+	// Get enclosing environment
+	Environment getEncloseEnv() const;
+
+	// Get layout of frame
+	const Layout& getLayout() const;
 
 	// Assign variable
-	Variable assignVariable(const Variable& var, const Variable& val);
+	Variable assignVariable(const Variable& var, Variable val);
+	Variable assignVariable(int depth, int slot, Variable val);
 
 	// Define variable
-	Variable defineVariable(const Variable& var, const Variable& val);
-	Variable defineVariable(const string& var, const Variable& val);
+	Variable defineVariable(const Variable& var, Variable val);
+	Variable defineVariable(const string& var, Variable val);
 
 	// Lookup variable
 	Variable lookupVariable(const Variable& var);
+	const Variable& lookupVariable(int depth, int slot) const;
+
+	// Find cell of defined global variable, null if not defined
+	Variable* findGlobal(const Variable& var) const;
+
+	// Check whether environment has been tagged
+	bool isTagged(int tag) const;
 
 	// Finalize values
-	void finalize() const override;
+	void finalize() const;
+
+	// Scan and tag frames in using, values referenced are pushed onto stack
+	void scan(int tag, GarbageCollector::MarkStack& stack) const;
+
+	// Scan and promote young frames in using, old frames aren't traversed
+	void scanYoung(GarbageCollector::MarkStack& stack) const;
+
+	// Count references to frames from outside, young frames only if young
+	void countRefs(std::vector<Environment>& frames, bool young) const;
+
+	// Discount references from frame to collected values
+	void discountRefs(bool young) const;
+
+	// Check whether frame is referenced from outside of collected values
+	bool isRoot() const;
 
-	// Scan and tag values in using
-	void scan(int tag) const override;
-};
\ No newline at end of file
+	// Reset frame after references counted
+	void resetRefs() const;
+};
@@ -3,9 +3,11 @@
 // 
 // Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
 //
+#include <vector>
 #include "evaluator.hpp"
 #include "variable.hpp"
 #include "exception.hpp"
+#include "syntax.hpp"
 
 #ifdef STATS
 #include "statistic.hpp"
@@ -15,289 +17,384 @@
 #include "log.hpp"
 #endif
 
-// Macro for evaluating
-
-#define TAGGED_LIST(exp, tag)	((exp).isPair() && (exp).car().toString() == (tag))
-// BOOL
-#define IS_TRUE(exp)			((exp) != VAR_FALSE)
-#define IS_FALSE(exp)			((exp) == VAR_FALSE)
-// SELF EVALUATING
-#define IS_SELF_EVALUATING(exp)	((exp).isNumber() || (exp).isString())
-// VARIABLE
-#define IS_VARIABLE(exp)		((exp).isSymbol())
-// QUOTED
-#define IS_QUOTED(exp)			TAGGED_LIST(exp, "quote")
-#define QUOTED(exp)				((exp).cdr().car())
-// DEFINE
-#define IS_DEFINE(exp)			TAGGED_LIST(exp, "define")
-#define IS_DEFINE_VAR(exp)		(IS_DEFINE(exp) && exp.cdr().car().isSymbol())
-#define IS_DEFINE_PROC(exp)		(IS_DEFINE(exp) && exp.cdr().car().isPair())
-#define DEFINE_VAR_NAME(exp)	((exp).cdr().car())
-#define DEFINE_VAR_VAL(exp)		((exp).cdr().cdr().car())
-#define DEFINE_PROC_NAME(exp)	((exp).cdr().car().car())
-#define DEFINE_PROC_ARGS(exp)	((exp).cdr().car().cdr())
-#define DEFINE_PROC_BODY(exp)	((exp).cdr().cdr())
-// ASSIGNMENT
-#define IS_ASSIGNMENT(exp)		TAGGED_LIST(exp, "set!")
-#define ASSIGNMENT_VAR(exp)		((exp).cdr().car())
-#define ASSIGNMENT_VAL(exp)		((exp).cdr().cdr().car())
-// SEQUENCE
-#define IS_SEQ(exp)				TAGGED_LIST(exp, "begin")
-#define SEQUENCE(exp)			((exp).cdr())
-// LAMBDA
-#define IS_LAMBDA(exp)			TAGGED_LIST(exp, "lambda")
-#define LAMBDA_ARGS(exp)		((exp).cdr().car())
-#define LAMBDA_BODY(exp)		((exp).cdr().cdr())
-// AND
-#define IS_AND(exp)				TAGGED_LIST(exp, "and")
-#define AND_ARGS(exp)			((exp).cdr())
-// OR
-#define IS_OR(exp)				TAGGED_LIST(exp, "or")
-#define OR_ARGS(exp)			((exp).cdr())
-// IF
-#define IS_IF(exp)				TAGGED_LIST(exp, "if")
-#define IF_PRED(exp)			((exp).cdr().car())
-#define IF_CON(exp)				((exp).cdr().cdr().car())
-#define IF_ALTER(exp)			((exp).cdr().cdr().cdr().car())
-#define IS_APPLICATION(exp)		((exp).isPair())
-#define IS_COND(exp)			TAGGED_LIST(exp, "cond")
-#define IS_ELSE(exp)			TAGGED_LIST(exp, "else")
-// COND
-#define COND_CLUASES(exp)		((exp).cdr())
-#define COND_PRED(exp)			((exp).car())
-#define COND_CONSEQUENCE(exp)	((exp).cdr())
-// LET
-#define IS_LET(exp)				TAGGED_LIST(exp, "let")
-#define LET_BINDINGS(exp)		((exp).cdr().car())
-#define BINDING_VAR(exp)		((exp).car())
-#define BINDING_VAL(exp)		((exp).cdr().car())
-#define LET_BODY(exp)			((exp).cdr().cdr())
-// APPLICATION
-#define APPLICATION_NAME(exp)	((exp).car())
-#define APPLICATION_ARGS(exp)	((exp).cdr())
-
 using namespace std;
 using namespace Evaluator;
+using namespace Syntax;
 
 namespace {
 
-	// Tail
-	struct Tail {
+	// Type alias
+	using NodePtr = shared_ptr<const Node>;
+
+	// Constant, self-evaluating or quoted
+	struct Constant: Node
+	{
+		Variable value;
 
-		// Is application?
-		bool app;
+		Constant(const Variable& value): value(value) {}
 
-		// Arguments for apply
-		Variable proc;
-		Variable args;
-		Environment env;
+		Variable eval(Environment &env) const override
+		{
+			return value;
+		}
+	};
 
-		// Constructor for value
-		Tail(const Variable& val): app(false), args(val) {}
+	// Reference to local variable
+	struct LocalReference: Node
+	{
+		int depth, slot;
 
-		// Constructor for application
-		Tail(const Variable& proc, const Variable& args, const Environment& env):
-			app(true), proc(proc), args(args), env(env) {}
+		LocalReference(int depth, int slot): depth(depth), slot(slot) {}
+
+		Variable eval(Environment &env) const override
+		{
+			return env.lookupVariable(depth, slot);
+		}
 	};
 
-	// Declare
-	Tail tail(const Variable &expr, Environment &env);
+	// Reference to global variable, cell is cached once defined
+	struct GlobalReference: Node
+	{
+		Variable var;
+		mutable Variable* cell = nullptr;
+
+		GlobalReference(const Variable& var): var(var) {}
 
-	// Evaluate and
-	Variable evalAnd(const Variable &expr, Environment &env)
+		Variable eval(Environment &env) const override
+		{
+			if (!cell && !(cell = env.findGlobal(var)))
+				return env.lookupVariable(var);
+			return *cell;
+		}
+	};
+
+	// Definition of local variable
+	struct LocalDefinition: Node
 	{
-		for (Variable it = AND_ARGS(expr); it != VAR_NULL; it = it.cdr())
-			if (IS_FALSE(eval(it.car(), env)))
-				return VAR_FALSE;
-		return VAR_TRUE;
-	}
+		int slot;
+		NodePtr val;
+
+		LocalDefinition(int slot, NodePtr val): slot(slot), val(std::move(val)) {}
 
-	// Evaluate or
-	Variable evalOr(const Variable &expr, Environment &env)
+		Variable eval(Environment &env) const override
+		{
+			return env.assignVariable(0, slot, val->eval(env));
+		}
+	};
+
+	// Definition by name
+	struct Definition: Node
 	{
-		for (Variable it = OR_ARGS(expr); it != VAR_NULL; it = it.cdr())
-			if (IS_TRUE(eval(it.car(), env)))
-				return VAR_TRUE;
-		return VAR_FALSE;
-	}
+		Variable var;
+		NodePtr val;
 
-	// Evaluate sequence
-	Variable evalSeq(const Variable &expr, Environment &env)
+		Definition(const Variable& var, NodePtr val): var(var), val(std::move(val)) {}
+
+		Variable eval(Environment &env) const override
+		{
+			return env.defineVariable(var, val->eval(env));
+		}
+	};
+
+	// Assignment of local variable
+	struct LocalAssignment: Node
 	{
-		Variable val = VAR_VOID;
-		for (Variable it = expr; it != VAR_NULL; it = it.cdr())
-			val = eval(it.car(), env);
-		return val;
-	}
+		int depth, slot;
+		NodePtr val;
 
-	// Evaluate condition
-	Variable evalCond(const Variable &expr, Environment &env)
+		LocalAssignment(int depth, int slot, NodePtr val): depth(depth), slot(slot), val(std::move(val)) {}
+
+		Variable eval(Environment &env) const override
+		{
+			return env.assignVariable(depth, slot, val->eval(env));
+		}
+	};
+
+	// Assignment of global variable, cell is cached once defined
+	struct GlobalAssignment: Node
 	{
-		for (Variable clauses = COND_CLUASES(expr); clauses != VAR_NULL; clauses = clauses.cdr()) {
-			const Variable& clause = clauses.car();
-			if (IS_ELSE(clause) || IS_TRUE(eval(COND_PRED(clause), env)))
-				return evalSeq(COND_CONSEQUENCE(clause), env);
+		Variable var;
+		NodePtr val;
+		mutable Variable* cell = nullptr;
+
+		GlobalAssignment(const Variable& var, NodePtr val): var(var), val(std::move(val)) {}
+
+		Variable eval(Environment &env) const override
+		{
+			Variable value = val->eval(env);
+			if (!cell && !(cell = env.findGlobal(var)))
+				return env.assignVariable(var, std::move(value));
+			GarbageCollector::writeBarrier(*cell);
+			*cell = std::move(value);
+			return VAR_VOID;
 		}
-		return VAR_VOID;
-	}
+	};
 
-	// Evaluate let
-	Variable evalLet(const Variable &expr, Environment &env)
+	// Sequence
+	struct Sequence: Node
 	{
-		Environment extendEnv = Environment(VAR_NULL, VAR_NULL, env);
-		for (Variable bindings = LET_BINDINGS(expr); bindings != VAR_NULL; bindings = bindings.cdr()) {
-			const Variable& binding = bindings.car();
-			extendEnv.defineVariable(BINDING_VAR(binding), eval(BINDING_VAL(binding), env));
+		vector<NodePtr> exps;
+
+		Variable eval(Environment &env) const override
+		{
+			Variable val = VAR_VOID;
+			for (const NodePtr& exp : exps)
+				val = exp->eval(env);
+			return val;
 		}
-		return evalSeq(LET_BODY(expr), extendEnv);
-	}
 
-	// Evaluate arguments
-	Variable evalArgs(const Variable &args, Environment &env)
+		Tail tail(Environment &env) const override
+		{
+			if (exps.empty())
+				return Tail(VAR_VOID);
+			for (size_t i = 0; i + 1 < exps.size(); i++)
+				exps[i]->eval(env);
+			return exps.back()->tail(env);
+		}
+	};
+
+	// Body of procedure
+	struct Procedure: Body
 	{
-		const Variable& head = Variable(VAR_NULL, VAR_NULL);
-		Variable tail = head;
-		for (Variable it = args; it != VAR_NULL; it = it.cdr()) {
-			const Variable& ntail = Variable(eval(it.car(), env), VAR_NULL);
-			tail.setCdr(ntail);
-			tail = ntail;
+		NodePtr seq;
+
+		Variable eval(Environment &env) const override
+		{
+			return seq->eval(env);
 		}
-		return head.cdr();
-	}
 
-	// Find the tail of sequence
-	Tail tailSeq(const Variable &expr, Environment &env)
+		Tail tail(Environment &env) const override
+		{
+			return seq->tail(env);
+		}
+	};
+
+	// Lambda
+	struct Lambda: Node
 	{
-		Variable tl = VAR_NULL;
-		for (Variable it = expr; it != VAR_NULL; it = it.cdr()) {
-			if (tl != VAR_NULL)
-				eval(tl, env);
-			tl = it.car();
+		string name;
+		Variable args, body;
+		shared_ptr<const Body> code;
+
+		Lambda(const string& name, const Variable& args, const Variable& body, shared_ptr<const Body> code):
+			name(name), args(args), body(body), code(std::move(code)) {}
+
+		Variable eval(Environment &env) const override
+		{
+			return Variable(name, args, body, env, code);
 		}
-		return tl == VAR_NULL ? Tail(VAR_VOID) : tail(tl, env);
-	}
+	};
 
-	// Find the tail of cond
-	Tail tailCond(const Variable &expr, Environment &env)
+	// And
+	struct And: Node
 	{
-		for (Variable clauses = COND_CLUASES(expr); clauses != VAR_NULL; clauses = clauses.cdr()) {
-			const Variable& clause = clauses.car();
-			if (IS_ELSE(clause) || IS_TRUE(eval(COND_PRED(clause), env)))
-				return tailSeq(COND_CONSEQUENCE(clause), env);
+		vector<NodePtr> exps;
+
+		Variable eval(Environment &env) const override
+		{
+			for (const NodePtr& exp : exps)
+				if (IS_FALSE(exp->eval(env)))
+					return VAR_FALSE;
+			return VAR_TRUE;
 		}
-		return Tail(VAR_VOID);
-	}
+	};
 
-	// Find the tail of let
-	Tail tailLet(const Variable &expr, Environment &env)
+	// Or
+	struct Or: Node
 	{
-		Environment extendEnv = Environment(VAR_NULL, VAR_NULL, env);
-		for (Variable bindings = LET_BINDINGS(expr); bindings != VAR_NULL; bindings = bindings.cdr()) {
-			const Variable& binding = bindings.car();
-			extendEnv.defineVariable(BINDING_VAR(binding), eval(BINDING_VAL(binding), env));
+		vector<NodePtr> exps;
+
+		Variable eval(Environment &env) const override
+		{
+			for (const NodePtr& exp : exps)
+				if (IS_TRUE(exp->eval(env)))
+					return VAR_TRUE;
+			return VAR_FALSE;
 		}
-		return tailSeq(LET_BODY(expr), extendEnv);
-	}
+	};
 
-	// Find the tail
-	Tail tail(const Variable &expr, Environment &env)
+	// If
+	struct If: Node
 	{
-		#ifdef LOG
-		VERBOSE("tail",expr);
-		#endif
-		if (IS_SELF_EVALUATING(expr)
-			|| IS_VARIABLE(expr)
-			|| IS_QUOTED(expr)
-			|| IS_DEFINE_VAR(expr)
-			|| IS_DEFINE_PROC(expr)
-			|| IS_ASSIGNMENT(expr)
-			|| IS_AND(expr)
-			|| IS_OR(expr)
-			|| IS_LAMBDA(expr))
-			return Tail(eval(expr, env));
-		if (IS_SEQ(expr))
-			return tailSeq(SEQUENCE(expr), env);
-		if (IS_IF(expr))	
-			return IS_TRUE(eval(IF_PRED(expr), env)) ? tail(IF_CON(expr), env) : tail(IF_ALTER(expr), env);
-		if (IS_COND(expr))
-			return tailCond(expr, env);
-		if (IS_LET(expr))
-			return tailLet(expr, env);
-		if (IS_APPLICATION(expr))	
-			return Tail(eval(APPLICATION_NAME(expr), env), evalArgs(APPLICATION_ARGS(expr), env), env);
-		throw Exception(string("tail: can't evaluate ") + expr.toString());
-	}
+		NodePtr pred, con, alter;
 
-}
+		If(NodePtr pred, NodePtr con, NodePtr alter):
+			pred(std::move(pred)), con(std::move(con)), alter(std::move(alter)) {}
 
-namespace Evaluator {
+		Variable eval(Environment &env) const override
+		{
+			return IS_TRUE(pred->eval(env)) ? con->eval(env) : alter->eval(env);
+		}
 
-	// Evaluate dispatcher
-	Variable eval(const Variable &expr, Environment &env)
+		Tail tail(Environment &env) const override
+		{
+			return IS_TRUE(pred->eval(env)) ? con->tail(env) : alter->tail(env);
+		}
+	};
+
+	// Condition, predicate of else clause is null
+	struct Cond: Node
 	{
-		#ifdef LOG
-		VERBOSE("eval",expr);
-		#endif
-		if (IS_SELF_EVALUATING(expr))
-			return expr;
-		if (IS_VARIABLE(expr))
-			return env.lookupVariable(expr);
-		if (IS_QUOTED(expr))
-			return QUOTED(expr);
-		if (IS_DEFINE_VAR(expr))
-			return env.defineVariable(DEFINE_VAR_NAME(expr), eval(DEFINE_VAR_VAL(expr), env));
-		if (IS_DEFINE_PROC(expr))
-			return env.defineVariable(DEFINE_PROC_NAME(expr), 
-					Variable(DEFINE_PROC_NAME(expr).toString(),
-						DEFINE_PROC_ARGS(expr),
-						DEFINE_PROC_BODY(expr), env));
-		if (IS_ASSIGNMENT(expr))
-			return env.assignVariable(ASSIGNMENT_VAR(expr), eval(ASSIGNMENT_VAL(expr), env));
-		if (IS_SEQ(expr))
-			return evalSeq(SEQUENCE(expr), env);
-		if (IS_AND(expr))
-			return evalAnd(expr, env);
-		if (IS_OR(expr))
-			return evalOr(expr, env);
-		if (IS_IF(expr))
-			return IS_TRUE(eval(IF_PRED(expr), env)) ? eval(IF_CON(expr), env) : eval(IF_ALTER(expr), env);
-		if (IS_COND(expr))
-			return evalCond(expr, env);
-		if (IS_LAMBDA(expr))
-			return Variable("lambda expression", LAMBDA_ARGS(expr), LAMBDA_BODY(expr), env);
-		if (IS_LET(expr))
-			return evalLet(expr, env);
-		if (IS_APPLICATION(expr))
-			return apply(eval(APPLICATION_NAME(expr), env), evalArgs(APPLICATION_ARGS(expr), env), env);
-		throw Exception(string("eval: can't evaluate ") + expr.toString());
-	}
+		vector<pair<NodePtr, NodePtr>> clauses;
 
-	// Apply procedure
-	Variable apply(const Variable &proc, const Variable &vals, Environment &env)
+		Variable eval(Environment &env) const override
+		{
+			for (const auto& clause : clauses)
+				if (!clause.first || IS_TRUE(clause.first->eval(env)))
+					return clause.second->eval(env);
+			return VAR_VOID;
+		}
+
+		Tail tail(Environment &env) const override
+		{
+			for (const auto& clause : clauses)
+				if (!clause.first || IS_TRUE(clause.first->eval(env)))
+					return clause.second->tail(env);
+			return Tail(VAR_VOID);
+		}
+	};
+
+	// Let
+	struct Let: Node
+	{
+		shared_ptr<const Environment::Layout> layout;
+		vector<NodePtr> vals;
+		NodePtr body;
+
+		Variable eval(Environment &env) const override
+		{
+			Environment extendEnv = bind(env);
+			return body->eval(extendEnv);
+		}
+
+		Tail tail(Environment &env) const override
+		{
+			Environment extendEnv = bind(env);
+			return body->tail(extendEnv);
+		}
+
+		// Bind values in a new environment
+		Environment bind(Environment &env) const
+		{
+			Environment extendEnv = Environment(layout, env);
+			for (size_t i = 0; i < vals.size(); i++)
+				extendEnv.assignVariable(0, i, vals[i]->eval(env));
+			return extendEnv;
+		}
+	};
+
+	// Declare
+	Variable run(Tail tl);
+
+	// Optimization: arguments of primitives are pushed onto a reusable stack
+	vector<Variable> values;
+
+	// Arguments of primitive on value stack, popped when out of scope
+	struct Arguments
+	{
+		size_t base;
+
+		Arguments(): base(values.size()) {}
+
+		~Arguments()
+		{
+			values.erase(values.begin() + base, values.end());
+		}
+
+		// Apply primitive, arguments are valid until it reenters evaluator
+		Variable apply(const Variable& proc, Environment& env) const
+		{
+			return proc(values.size() - base, values.data() + base, env);
+		}
+	};
+
+	// Application
+	struct Application: Node
+	{
+		NodePtr proc;
+		vector<NodePtr> args;
+
+		Variable eval(Environment &env) const override
+		{
+			return run(tail(env));
+		}
+
+		Tail tail(Environment &env) const override
+		{
+			Variable func = proc->eval(env);
+			if (func.isPrim()) {
+				Arguments argv;
+				for (const NodePtr& arg : args)
+					values.push_back(arg->eval(env));
+				try {
+					return Tail(argv.apply(func, env));
+				} catch (Exception e) {
+					e.addTrace(func.toString());
+					throw e;
+				}
+			}
+			if (!func.isComp())
+				return Tail(std::move(func), evalArgs(env), env);
+			// Optimization: arguments of compound are evaluated into its frame
+			const Body& code = func.getProcedureCode();
+			Environment extendEnv = Environment(code.layout, func.getProcedureEnv());
+			for (size_t i = 0; i < args.size(); i++) {
+				Variable val = args[i]->eval(env);
+				if ((int) i < code.argc)
+					extendEnv.assignVariable(0, i, std::move(val));
+			}
+			return Tail(std::move(func), std::move(extendEnv));
+		}
+
+		// Evaluate arguments
+		Variable evalArgs(Environment &env) const
+		{
+			const Variable& head = Variable(VAR_NULL, VAR_NULL);
+			Variable tail = head;
+			for (const NodePtr& arg : args) {
+				Variable ntail = Variable(arg->eval(env), VAR_NULL);
+				tail.setCdr(ntail);
+				tail = std::move(ntail);
+			}
+			return head.cdr();
+		}
+	};
+
+	// Run application until value
+	Variable run(Tail tl)
 	{
 		#ifdef STATS
 		Statistic::applyStart();
 		#endif
+		const Variable func = tl.proc;
 		try {
-			Tail tl = Tail(proc, vals, env);
 			while (tl.app) {
+				// Safe point, values in using are referenced by tail and frames
+				GarbageCollector::safePoint();
 				const Variable& proc = tl.proc;
 				const Variable& vals = tl.args;
 				Environment& env = tl.env;
 				#ifdef LOG
 				VERBOSE("apply",proc);
 				#endif
-				if (proc.isPrim()) {		// Apply primitives
+				if (tl.bound) {				// Apply compound with bound arguments
+					tl = proc.getProcedureCode().tail(env);
+				} else if (proc.isPrim()) {	// Apply primitives
+					Arguments argv;
+					for (const Variable* it = &vals; !it->isNull(); it = &it->cdr())
+						values.push_back(it->car());
 					#ifdef STATS
-					tl = Tail(proc(vals, env));
+					tl = Tail(argv.apply(proc, env));
 					#else
-					return proc(vals, env);
+					return argv.apply(proc, env);
 					#endif
 				} else if (proc.isComp()) {	// Apply compound
-					const Variable& body = proc.getProcedureBody();
-					const Variable& args = proc.getProcedureArgs();
-					Environment extendEnv = Environment(args, vals, proc.getProcedureEnv());
-					tl = tailSeq(body, extendEnv);
+					const Body& code = proc.getProcedureCode();
+					Environment extendEnv = Environment(code.layout, proc.getProcedureEnv());
+					int i = 0;
+					for (const Variable* it = &vals; !it->isNull() && i < code.argc; it = &it->cdr(), i++)
+						extendEnv.assignVariable(0, i, it->car());
+					tl = code.tail(extendEnv);
 				} else {					// Exception
 					throw Exception(string("apply: can't apply ") + proc.toString());
 				}
@@ -307,9 +404,178 @@ namespace Evaluator {
 			#endif
 			return tl.args;
 		} catch (Exception e) {
-			e.addTrace(proc.toString());
+			e.addTrace(func.toString());
 			throw e;
 		}
 	}
 
-}
\ No newline at end of file
+	// Declare
+	NodePtr analyze(const Variable &expr, Resolver &resolver);
+
+	// Analyze each expression in list
+	vector<NodePtr> analyzeList(const Variable &exps, Resolver &resolver)
+	{
+		vector<NodePtr> nodes;
+		for (const Variable* it = &exps; !it->isNull(); it = &it->cdr())
+			nodes.push_back(analyze(it->car(), resolver));
+		return nodes;
+	}
+
+	// Analyze sequence
+	NodePtr analyzeSeq(const Variable &exps, Resolver &resolver)
+	{
+		auto node = make_shared<Sequence>();
+		node->exps = analyzeList(exps, resolver);
+		return node;
+	}
+
+	// Analyze variable reference
+	NodePtr analyzeReference(const Variable &var, Resolver &resolver)
+	{
+		int depth, slot;
+		if (resolver.resolve(var, depth, slot))
+			return make_shared<LocalReference>(depth, slot);
+		return make_shared<GlobalReference>(var);
+	}
+
+	// Analyze definition, variables not in current frame are defined by name
+	NodePtr analyzeDefinition(const Variable &var, NodePtr val, Resolver &resolver)
+	{
+		int depth, slot;
+		if (resolver.resolve(var, depth, slot) && depth == 0)
+			return make_shared<LocalDefinition>(slot, std::move(val));
+		return make_shared<Definition>(var, std::move(val));
+	}
+
+	// Analyze assignment
+	NodePtr analyzeAssignment(const Variable &var, NodePtr val, Resolver &resolver)
+	{
+		int depth, slot;
+		if (resolver.resolve(var, depth, slot))
+			return make_shared<LocalAssignment>(depth, slot, std::move(val));
+		return make_shared<GlobalAssignment>(var, std::move(val));
+	}
+
+	// Analyze lambda
+	NodePtr analyzeLambda(const string &name, const Variable &args, const Variable &body, Resolver &resolver)
+	{
+		auto code = make_shared<Procedure>();
+		for (const Variable* it = &args; !it->isNull(); it = &it->cdr())
+			code->argc++;
+		code->layout = resolver.enterLambda(args, body);
+		code->seq = analyzeSeq(body, resolver);
+		resolver.leave();
+		return make_shared<Lambda>(name, args, body, code);
+	}
+
+	// Analyze condition
+	NodePtr analyzeCond(const Variable &expr, Resolver &resolver)
+	{
+		auto node = make_shared<Cond>();
+		for (const Variable* clauses = &COND_CLUASES(expr); !clauses->isNull(); clauses = &clauses->cdr()) {
+			const Variable& clause = clauses->car();
+			NodePtr pred = IS_ELSE(clause) ? nullptr : analyze(COND_PRED(clause), resolver);
+			node->clauses.emplace_back(pred, analyzeSeq(COND_CONSEQUENCE(clause), resolver));
+		}
+		return node;
+	}
+
+	// Analyze let
+	NodePtr analyzeLet(const Variable &expr, Resolver &resolver)
+	{
+		auto node = make_shared<Let>();
+		for (const Variable* bindings = &LET_BINDINGS(expr); !bindings->isNull(); bindings = &bindings->cdr())
+			node->vals.push_back(analyze(BINDING_VAL(bindings->car()), resolver));
+		node->layout = resolver.enterLet(LET_BINDINGS(expr), LET_BODY(expr));
+		node->body = analyzeSeq(LET_BODY(expr), resolver);
+		resolver.leave();
+		return node;
+	}
+
+	// Analyze application
+	NodePtr analyzeApplication(const Variable &expr, Resolver &resolver)
+	{
+		auto node = make_shared<Application>();
+		node->proc = analyze(APPLICATION_NAME(expr), resolver);
+		node->args = analyzeList(APPLICATION_ARGS(expr), resolver);
+		return node;
+	}
+
+	// Analyze expression into executable node
+	NodePtr analyze(const Variable &expr, Resolver &resolver)
+	{
+		#ifdef LOG
+		VERBOSE("analyze",expr);
+		#endif
+		if (IS_SELF_EVALUATING(expr))
+			return make_shared<Constant>(expr);
+		if (IS_VARIABLE(expr))
+			return analyzeReference(expr, resolver);
+		switch (formOf(expr)) {
+			case FORM_QUOTE:
+				return make_shared<Constant>(QUOTED(expr));
+			case FORM_DEFINE:
+				if (IS_DEFINE_PROC(expr))
+					return analyzeDefinition(DEFINE_PROC_NAME(expr),
+						analyzeLambda(DEFINE_PROC_NAME(expr).toString(),
+							DEFINE_PROC_ARGS(expr),
+							DEFINE_PROC_BODY(expr), resolver), resolver);
+				return analyzeDefinition(DEFINE_VAR_NAME(expr), analyze(DEFINE_VAR_VAL(expr), resolver), resolver);
+			case FORM_ASSIGNMENT:
+				return analyzeAssignment(ASSIGNMENT_VAR(expr), analyze(ASSIGNMENT_VAL(expr), resolver), resolver);
+			case FORM_SEQ:
+				return analyzeSeq(SEQUENCE(expr), resolver);
+			case FORM_AND: {
+				auto node = make_shared<And>();
+				node->exps = analyzeList(AND_ARGS(expr), resolver);
+				return node;
+			}
+			case FORM_OR: {
+				auto node = make_shared<Or>();
+				node->exps = analyzeList(OR_ARGS(expr), resolver);
+				return node;
+			}
+			case FORM_IF:
+				return make_shared<If>(analyze(IF_PRED(expr), resolver), analyze(IF_CON(expr), resolver),
+					HAS_IF_ALTER(expr) ? analyze(IF_ALTER(expr), resolver) : make_shared<Constant>(VAR_VOID));
+			case FORM_COND:
+				return analyzeCond(expr, resolver);
+			case FORM_LAMBDA:
+				return analyzeLambda("lambda expression", LAMBDA_ARGS(expr), LAMBDA_BODY(expr), resolver);
+			case FORM_LET:
+				return analyzeLet(expr, resolver);
+			case FORM_APPLICATION:
+			case FORM_ELSE:
+				return analyzeApplication(expr, resolver);
+			default:
+				throw Exception(string("analyze: can't analyze ") + expr.toString());
+		}
+	}
+
+}
+
+namespace Evaluator {
+
+	// Analyze expression into executable node, locals are resolved in frames of environment
+	shared_ptr<const Node> analyze(const Variable &expr, const Environment &env)
+	{
+		Resolver resolver = Resolver(env);
+		return ::analyze(expr, resolver);
+	}
+
+	// Evaluate dispatcher
+	Variable eval(const Variable &expr, Environment &env)
+	{
+		#ifdef LOG
+		VERBOSE("eval",expr);
+		#endif
+		return analyze(expr, env)->eval(env);
+	}
+
+	// Apply procedure
+	Variable apply(const Variable &proc, const Variable &vals, Environment &env)
+	{
+		return run(Tail(proc, vals, env));
+	}
+
+}
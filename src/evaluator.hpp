@@ -5,14 +5,70 @@
 //
 #pragma once
 
+#include <memory>
 #include "variable.hpp"
 
 namespace Evaluator {
 
+	// Tail of evaluation, a value or an application left to the caller
+	struct Tail {
+
+		// Is application?
+		bool app;
+
+		// Are arguments bound in environment?
+		bool bound;
+
+		// Arguments for apply
+		Variable proc;
+		Variable args;
+		Environment env;
+
+		// Constructor for value
+		Tail(Variable val): app(false), bound(false), proc(VAR_NULL), args(std::move(val)) {}
+
+		// Constructor for application
+		Tail(Variable proc, Variable args, Environment env):
+			app(true), bound(false), proc(std::move(proc)), args(std::move(args)), env(std::move(env)) {}
+
+		// Constructor for application of compound, arguments are bound in env
+		Tail(Variable proc, Environment env):
+			app(true), bound(true), proc(std::move(proc)), args(VAR_NULL), env(std::move(env)) {}
+	};
+
+	// Analyzed expression
+	class Node
+	{
+	public:
+
+		virtual ~Node() {}
+
+		// Evaluate in environment
+		virtual Variable eval(Environment &env) const = 0;
+
+		// Evaluate in environment, application in tail position is left to caller
+		virtual Tail tail(Environment &env) const { return Tail(eval(env)); }
+	};
+
+	// Analyzed body of procedure
+	class Body: public Node
+	{
+	public:
+
+		// Slots of frame, arguments first and then internal definitions
+		std::shared_ptr<const Environment::Layout> layout;
+
+		// Count of arguments
+		int argc = 0;
+	};
+
+	// Analyze expression into executable node, locals are resolved in frames of environment
+	std::shared_ptr<const Node> analyze(const Variable &exp, const Environment &env);
+
 	// Evaluate dispatcher
 	Variable eval(const Variable &exp, Environment &env);
 
 	// Apply procedure
 	Variable apply(const Variable &proc, const Variable &vals, Environment &env);
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,366 @@
+//
+// Fasl cache of code read from source file
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "fasl.hpp"
+
+namespace {
+
+	// Magic at beginning of cache, changed with layout
+	const char MAGIC[] = "SSFASL2\n";
+	const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+	// Tags of datums
+	enum Tag {
+		TAG_NULL,			// Empty list
+		TAG_FIXNUM,			// Integer in machine word, zigzag encoded
+		TAG_RATIONAL,		// Other rational as text
+		TAG_FLOAT,			// Bits of double
+		TAG_STRING,			// Bytes of string
+		TAG_SYMBOL,			// Index of symbol
+		TAG_LIST			// Count of items, items, then tail
+	};
+
+	// Cache is truncated or broken
+	struct Corrupt {};
+
+	// Write fixed 64 bits in little endian
+	void writeWord(std::string& out, uint64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+			out.push_back(static_cast<char>(value >> (i * 8)));
+	}
+
+	// Match -?digits(/digits)? with nonzero denominator, so that text of rational is parsed without error
+	bool isRationalText(const char* text, size_t length)
+	{
+		size_t i = length && text[0] == '-';
+		size_t digits = 0;
+		bool slash = false, nonzero = false;
+		for (; i < length; i++) {
+			if (text[i] == '/' && digits && !slash) {
+				slash = true;
+				digits = 0;
+			} else if (isdigit(static_cast<unsigned char>(text[i]))) {
+				digits++;
+				nonzero |= slash && text[i] != '0';
+			} else {
+				return false;
+			}
+		}
+		return digits > 0 && (!slash || nonzero);
+	}
+
+	// Read fixed 64 bits in little endian
+	uint64_t readWord(const char* p)
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++)
+			value |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+		return value;
+	}
+}
+
+// FNV-1a
+uint64_t Fasl::hash(const char* begin, const char* end)
+{
+	uint64_t value = 14695981039346656037ULL;
+	for (const char* p = begin; p < end; p++)
+		value = (value ^ static_cast<unsigned char>(*p)) * 1099511628211ULL;
+	return value;
+}
+
+std::string Fasl::cachePath(const std::string& source)
+{
+	size_t size = source.size();
+	if (size > 4 && source.compare(size - 4, 4, ".scm") == 0)
+		return source.substr(0, size - 4) + ".fasl";
+	return source + ".fasl";
+}
+
+// Writer
+
+Fasl::Writer::Writer(): valid(true) {}
+
+// Optimization: datums are walked by loop with a stack instead of recursion, like reader,
+// so that deeply nested datum is cached without overflow
+void Fasl::Writer::write(const Variable& var)
+{
+	pending.push_back(&var);
+	while (!pending.empty()) {
+		const Variable* datum = pending.back();
+		pending.pop_back();
+		if (datum->type != Variable::TYPE_PAIR) {
+			writeAtom(*datum);
+			continue;
+		}
+		// Pairs along cdr are written as list, items are pushed above tail in reverse
+		size_t count = 0;
+		const Variable* tail = datum;
+		for (; tail->type == Variable::TYPE_PAIR; tail = &tail->pairPtr->second)
+			count++;
+		body.push_back(TAG_LIST);
+		writeNumber(body, count);
+		pending.push_back(tail);
+		size_t base = pending.size();
+		for (const Variable* it = datum; it != tail; it = &it->pairPtr->second)
+			pending.push_back(&it->pairPtr->first);
+		std::reverse(pending.begin() + base, pending.end());
+	}
+}
+
+void Fasl::Writer::writeAtom(const Variable& var)
+{
+	switch (var.type) {
+		case Variable::TYPE_RATIONAL: {
+			if (var.isFixnum()) {
+				// Zigzag, so that small negative integer is short
+				uint64_t value = static_cast<uint64_t>(var.fixnum);
+				body.push_back(TAG_FIXNUM);
+				writeNumber(body, (value << 1) ^ static_cast<uint64_t>(var.fixnum >> 63));
+				return;
+			}
+			std::string text = var.toString();
+			body.push_back(TAG_RATIONAL);
+			writeNumber(body, text.size());
+			body += text;
+			return;
+		}
+		case Variable::TYPE_FLOAT: {
+			uint64_t bits;
+			memcpy(&bits, &var.doublePtr->value, sizeof(bits));
+			body.push_back(TAG_FLOAT);
+			writeWord(body, bits);
+			return;
+		}
+		case Variable::TYPE_STRING: {
+			const std::string& text = var.stringPtr->value;
+			body.push_back(TAG_STRING);
+			writeNumber(body, text.size());
+			body += text;
+			return;
+		}
+		case Variable::TYPE_SYMBOL: {
+			auto it = symbolIndex.find(var.symbolPtr);
+			if (it == symbolIndex.end()) {
+				it = symbolIndex.emplace(var.symbolPtr, symbols.size()).first;
+				symbols.push_back(var);
+			}
+			body.push_back(TAG_SYMBOL);
+			writeNumber(body, it->second);
+			return;
+		}
+		default:
+			// Other values than empty list are never read from source
+			if (var.isNull())
+				body.push_back(TAG_NULL);
+			else
+				valid = false;
+	}
+}
+
+void Fasl::Writer::writeNumber(std::string& out, uint64_t value)
+{
+	for (; value >= 0x80; value >>= 7)
+		out.push_back(static_cast<char>(value | 0x80));
+	out.push_back(static_cast<char>(value));
+}
+
+bool Fasl::Writer::save(const std::string& path, uint64_t hash) const
+{
+	if (!valid)
+		return false;
+	std::string head(MAGIC, MAGIC_SIZE);
+	writeWord(head, hash);
+	writeNumber(head, symbols.size());
+	for (const Variable& symbol : symbols) {
+		const std::string& name = symbol.symbolPtr->name;
+		writeNumber(head, name.size());
+		head += name;
+	}
+	// Cache is written aside and renamed, so that a partial cache is never loaded
+	std::string temp = path + ".tmp";
+	std::ofstream fout(temp, std::ios::binary);
+	fout.write(head.data(), head.size());
+	fout.write(body.data(), body.size());
+	fout.close();
+	if (!fout || std::rename(temp.c_str(), path.c_str()) != 0) {
+		std::remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Loader
+
+Fasl::Loader::Loader(const std::string& path, uint64_t hash):
+	file(path), pos(file.begin()), end(file.end()), opened(false)
+{
+	if (!file.isOpen() || static_cast<size_t>(end - pos) < MAGIC_SIZE + 8
+		|| memcmp(pos, MAGIC, MAGIC_SIZE) != 0 || readWord(pos + MAGIC_SIZE) != hash)
+		return;
+	pos += MAGIC_SIZE + 8;
+	try {
+		// Optimization: symbols are interned from views into cache
+		size_t count = readNumber();
+		symbols.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			size_t length = readNumber();
+			symbols.push_back(Variable::createSymbol(readBytes(length), length));
+		}
+		// Whole cache is checked before any datum is loaded, so that a broken cache is never run halfway
+		const char* body = pos;
+		while (pos < end)
+			checkDatum();
+		pos = body;
+		opened = true;
+	} catch (Corrupt) {
+		symbols.clear();
+	}
+}
+
+bool Fasl::Loader::read(Variable& var)
+{
+	if (!opened || pos == end)
+		return false;
+	var = readDatum();
+	return true;
+}
+
+void Fasl::Loader::checkDatum()
+{
+	// Datums left in lists are counted instead of walked by recursion
+	for (uint64_t remain = 1; remain > 0; remain--) {
+		int tag = readByte();
+		switch (tag) {
+			case TAG_NULL:
+				break;
+			case TAG_FIXNUM:
+				readNumber();
+				break;
+			case TAG_RATIONAL:
+			case TAG_STRING: {
+				size_t length = readNumber();
+				const char* text = readBytes(length);
+				if (tag == TAG_RATIONAL && !isRationalText(text, length))
+					throw Corrupt();
+				break;
+			}
+			case TAG_FLOAT:
+				readBytes(8);
+				break;
+			case TAG_SYMBOL:
+				if (readNumber() >= symbols.size())
+					throw Corrupt();
+				break;
+			case TAG_LIST: {
+				// Each datum left takes a byte at least, so that a broken count is found at once
+				uint64_t count = readNumber();
+				uint64_t left = static_cast<uint64_t>(end - pos);
+				if (count > left || count + remain > left)
+					throw Corrupt();
+				remain += count + 1;
+				break;
+			}
+			default:
+				throw Corrupt();
+		}
+	}
+}
+
+// Optimization: lists are built by loop with frames instead of recursion, like reader.
+// Items are kept on a shared stack and consed from the last when list is complete
+Variable Fasl::Loader::readDatum()
+{
+	Variable value;
+	for (;;) {
+		int tag = readByte();
+		if (tag == TAG_LIST) {
+			size_t count = readNumber();
+			frames.push_back({count + 1, items.size()});
+			continue;
+		}
+		value = readAtom(tag);
+		// Lists whose items and tail are all loaded are completed
+		for (;;) {
+			if (frames.empty())
+				return value;
+			items.push_back(std::move(value));
+			Frame frame = frames.back();
+			if (items.size() - frame.base < frame.size)
+				break;
+			value = std::move(items.back());
+			for (size_t i = items.size() - 1; i-- > frame.base; )
+				value = Variable(std::move(items[i]), std::move(value));
+			items.resize(frame.base);
+			frames.pop_back();
+		}
+	}
+}
+
+Variable Fasl::Loader::readAtom(int tag)
+{
+	switch (tag) {
+		case TAG_NULL:
+			return VAR_NULL;
+		case TAG_FIXNUM: {
+			uint64_t value = readNumber();
+			return Variable(static_cast<long>((value >> 1) ^ -(value & 1)));
+		}
+		case TAG_RATIONAL:
+		case TAG_STRING: {
+			size_t length = readNumber();
+			const char* text = readBytes(length);
+			return Variable(std::string(text, length), tag == TAG_STRING ? Variable::TYPE_STRING : Variable::TYPE_RATIONAL);
+		}
+		case TAG_FLOAT: {
+			uint64_t bits = readWord(readBytes(8));
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			return Variable(value);
+		}
+		case TAG_SYMBOL: {
+			size_t index = readNumber();
+			if (index >= symbols.size())
+				throw Corrupt();
+			return symbols[index];
+		}
+		default:
+			throw Corrupt();
+	}
+}
+
+int Fasl::Loader::readByte()
+{
+	if (pos == end)
+		throw Corrupt();
+	return static_cast<unsigned char>(*pos++);
+}
+
+const char* Fasl::Loader::readBytes(size_t length)
+{
+	if (static_cast<size_t>(end - pos) < length)
+		throw Corrupt();
+	const char* bytes = pos;
+	pos += length;
+	return bytes;
+}
+
+uint64_t Fasl::Loader::readNumber()
+{
+	uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int byte = readByte();
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+	throw Corrupt();
+}
@@ -0,0 +1,106 @@
+//
+// Fasl cache of code read from source file
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "variable.hpp"
+#include "source.hpp"
+
+// Optimization: datums read from source file are cached in binary form next to it, so that
+// later runs load them without reading text. Cache is reused while hash of source matches.
+//
+// Layout: magic, hash of source, table of symbols, then datums one by one. Runs of pairs along
+// cdr are written as lists. Pairs are never shared within datum read from source, so that
+// each pair is written once without looking for shared structure.
+namespace Fasl {
+
+	// Hash of source bytes
+	uint64_t hash(const char* begin, const char* end);
+
+	// Path of cache of source, extension .scm is replaced by .fasl
+	std::string cachePath(const std::string& source);
+
+	// Writer of datums into cache, saved after all datums are written
+	class Writer
+	{
+	public:
+
+		// Constructor
+		Writer();
+
+		// Write a datum, it should be written before it is evaluated and mutated
+		void write(const Variable& var);
+
+		// Save cache for source hash, return false if it can't be saved
+		bool save(const std::string& path, uint64_t hash) const;
+
+	private:
+
+		// Symbols are identified by address
+		using Address = const void*;
+
+		std::string body;								// Datums written
+		std::vector<Variable> symbols;					// Symbols by index, kept alive until saved
+		std::unordered_map<Address, size_t> symbolIndex;	// Indices of symbols
+		std::vector<const Variable*> pending;			// Datums waiting to be written
+		bool valid;										// Is every datum supported?
+
+		// Write datum other than pair
+		void writeAtom(const Variable& var);
+
+		// Write unsigned integer in 7-bit groups
+		static void writeNumber(std::string& out, uint64_t value);
+	};
+
+	// Loader of datums from cache
+	class Loader
+	{
+	public:
+
+		// Constructor, cache is opened if it's written for source hash and is well-formed
+		Loader(const std::string& path, uint64_t hash);
+
+		// Is cache opened?
+		bool isOpen() const { return opened; }
+
+		// Load a datum, return false at end of cache
+		bool read(Variable& var);
+
+	private:
+
+		// List being loaded
+		struct Frame
+		{
+			size_t size;				// Count of items and tail
+			size_t base;				// Index of first item in items
+		};
+
+		SourceFile file;				// Cache mapped into memory
+		const char* pos;				// Position of next byte
+		const char* end;				// End of cache
+		std::vector<Variable> symbols;	// Symbols by index
+		std::vector<Variable> items;	// Items of lists being loaded
+		std::vector<Frame> frames;		// Lists being loaded
+		bool opened;					// Is cache opened?
+
+		// Load datum
+		Variable readDatum();
+
+		// Load datum other than list
+		Variable readAtom(int tag);
+
+		// Check datum without loading it
+		void checkDatum();
+
+		// Read a byte, bytes of view and unsigned integer
+		int readByte();
+		const char* readBytes(size_t length);
+		uint64_t readNumber();
+	};
+}
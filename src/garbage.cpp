@@ -1,10 +1,16 @@
-// 
+//
 // Garbage collector
-// 
+//
 // Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
-// 
+//
 #include <vector>
-#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iterator>
+#include <algorithm>
 #include "garbage.hpp"
 #include "variable.hpp"
 
@@ -15,33 +21,510 @@
 using std::vector;
 
 namespace {
-	vector<Variable> traceList;
+
+	// Type alias
+	using Clock = std::chrono::steady_clock;
+
+	// Optimization: objects are collected in generations
+	vector<Variable> youngList;				// Objects allocated since last collection
+	vector<Variable> oldList;				// Objects survived collections
+
+	// Optimization: code is immortal and never marked, mutated code is remembered since it may reference collected objects
+	vector<Variable> mutatedCode;
+
+	// Size of old generation triggering full collection
+	const size_t MIN_FULL_THRESHOLD = 8;
+	size_t fullThreshold = MIN_FULL_THRESHOLD;
+
+	// Optimization: collection is triggered by allocation
+	size_t budget = GarbageCollector::DEFAULT_BUDGET;
+	size_t allocated = 0;
+
+	// Epoch of last full collection, objects marked are tagged with it
+	int epoch = 0;
+
+	// Optimization: values are marked by explicit stack instead of recursion
+	GarbageCollector::MarkStack markStack;
+
+	// Phase of incremental full collection
+	enum Phase { PHASE_IDLE, PHASE_MARKING, PHASE_SWEEPING };
+	Phase phase = PHASE_IDLE;
+
+	// Optimization: full collection is split into slices no longer than max pause, zero if stop-the-world
+	Clock::duration maxPause = Clock::duration::zero();
+	Clock::time_point nextSlice;
+
+	// Full collection is due but deferred, since incremental marking only starts at top-level
+	bool fullPending = false;
+
+	// Objects in old generation when incremental marking starts are condemned, objects promoted later survive
+	size_t condemned = 0;		// End of condemned objects
+	size_t swept = 0;			// Count of condemned objects swept
+	size_t alive = 0;			// Count of condemned objects survived
+
+	// Count of objects processed between reading clock
+	const size_t CLOCK_INTERVAL = 64;
+
+	// Optimization: full collection is marked by worker threads stealing values from each other
+	int markThreads = 1;
+
+	// Values shared by a marker, owner takes from back and thieves steal from front
+	struct WorkDeque
+	{
+		std::mutex mutex;
+		std::deque<const Variable*> values;
+	};
+
+	// Count of objects scanned between sharing values
+	const size_t SHARE_INTERVAL = 64;
+
+	// Scan values on mark stack until empty or deadline, return whether empty
+	bool drain(int tag, Clock::time_point deadline)
+	{
+		size_t count = 0;
+		while (!markStack.empty()) {
+			const Variable* var = markStack.back();
+			markStack.pop_back();
+			// Optimization: cdr-chain is scanned in loop
+			while (var && !var->isTagged(tag)) {
+				var = var->scan(tag, markStack);
+				if (++count % CLOCK_INTERVAL == 0 && Clock::now() >= deadline) {
+					if (var)
+						markStack.push_back(var);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Scan young values on mark stack until it is back to base, values below are left for incremental marking
+	void drainYoung(size_t base)
+	{
+		while (markStack.size() > base) {
+			const Variable* var = markStack.back();
+			markStack.pop_back();
+			// Optimization: cdr-chain is scanned in loop
+			while (var && var->isYoung())
+				var = var->scanYoung(markStack);
+		}
+	}
+
+	// Promote young values in using
+	struct ScanYoung
+	{
+		void operator()(const Variable& var) const
+		{
+			size_t base = markStack.size();
+			markStack.push_back(&var);
+			drainYoung(base);
+		}
+
+		void operator()(const Environment& env) const
+		{
+			size_t base = markStack.size();
+			env.scanYoung(markStack);
+			drainYoung(base);
+		}
+	};
+
+	// Tag values in using
+	struct Scan
+	{
+		int tag;
+
+		void operator()(const Variable& var) const
+		{
+			markStack.push_back(&var);
+			drain(tag, Clock::time_point::max());
+		}
+
+		void operator()(const Environment& env) const
+		{
+			if (!env.isTagged(tag))
+				env.scan(tag, markStack);
+			drain(tag, Clock::time_point::max());
+		}
+	};
+
+	// Collect roots onto stack to be marked in parallel, frames are scanned in place
+	struct Push
+	{
+		int tag;
+		GarbageCollector::MarkStack& roots;
+
+		void operator()(const Variable& var) const
+		{
+			roots.push_back(&var);
+		}
+
+		void operator()(const Environment& env) const
+		{
+			if (!env.isTagged(tag))
+				env.scan(tag, roots);
+		}
+	};
+
+	// Move bottom half of local values into deque once it has run dry, so that idle markers can steal them
+	void share(WorkDeque& deque, GarbageCollector::MarkStack& stack)
+	{
+		std::lock_guard<std::mutex> lock(deque.mutex);
+		if (!deque.values.empty())
+			return;
+		size_t half = stack.size() / 2;
+		deque.values.insert(deque.values.end(), stack.begin(), stack.begin() + half);
+		stack.erase(stack.begin(), stack.begin() + half);
+	}
+
+	// Take all values from own deque or steal half from others, return whether any is taken
+	bool take(WorkDeque& deque, GarbageCollector::MarkStack& stack, bool steal)
+	{
+		std::lock_guard<std::mutex> lock(deque.mutex);
+		if (deque.values.empty())
+			return false;
+		if (steal) {
+			auto half = deque.values.begin() + (deque.values.size() + 1) / 2;
+			stack.insert(stack.end(), deque.values.begin(), half);
+			deque.values.erase(deque.values.begin(), half);
+		} else {
+			stack.insert(stack.end(), deque.values.begin(), deque.values.end());
+			deque.values.clear();
+		}
+		return true;
+	}
+
+	// Mark values until all markers are out of values, a marker runs out only when its deque is empty
+	// and it pushes nothing before stealing again, so no values are left once none is active
+	void markWorker(int id, int tag, vector<WorkDeque>& deques, std::atomic<int>& active)
+	{
+		GarbageCollector::MarkStack stack;
+		size_t count = 0;
+		for (;;) {
+			while (!stack.empty()) {
+				const Variable* var = stack.back();
+				stack.pop_back();
+				// Optimization: cdr-chain is scanned in loop
+				while (var && var->claim(tag)) {
+					var = var->scan(tag, stack);
+					if (++count % SHARE_INTERVAL == 0 && stack.size() > 1)
+						share(deques[id], stack);
+				}
+			}
+			if (take(deques[id], stack, false))
+				continue;
+			active--;
+			while (stack.empty()) {
+				if (active == 0)
+					return;
+				active++;
+				for (int i = 1; i < markThreads && stack.empty(); i++)
+					take(deques[(id + i) % markThreads], stack, true);
+				if (stack.empty()) {
+					active--;
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	// Mark values from roots in parallel, roots are dealt to markers evenly
+	void markParallel(int tag, const GarbageCollector::MarkStack& roots)
+	{
+		vector<WorkDeque> deques(markThreads);
+		for (size_t i = 0; i < roots.size(); i++)
+			deques[i % markThreads].values.push_back(roots[i]);
+		std::atomic<int> active(markThreads);
+		vector<std::thread> workers;
+		for (int i = 1; i < markThreads; i++)
+			workers.emplace_back(markWorker, i, tag, std::ref(deques), std::ref(active));
+		markWorker(0, tag, deques, active);
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	// Free unreached object, fields are cleared before freeing so that freeing never cascades
+	void release(Variable& var)
+	{
+		Variable garbage = std::move(var);
+		garbage.finalize();
+		#ifdef STATS
+		Statistic::finalizeVariable();
+		#endif
+	}
+
+	// Free unreached objects in place, reached objects are moved to the front and kept
+	template <typename Reached>
+	void sweep(vector<Variable>& list, Reached reached)
+	{
+		size_t alive = 0;
+		for (Variable& var : list)
+			if (reached(var))
+				list[alive++] = std::move(var);
+			else
+				release(var);
+		list.resize(alive);
+	}
+
+	// Move objects survived into old generation
+	void promote(vector<Variable>& list)
+	{
+		for (const Variable& var : list)
+			var.promote();
+		oldList.insert(oldList.end(), std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()));
+		list.clear();
+	}
+
+	// Find roots, which are objects referenced from outside of collected objects,
+	// such as globals, frames and values in using by evaluation
+	template <typename Mark>
+	void markRoots(const vector<vector<Variable>*>& lists, bool young, Mark mark)
+	{
+		vector<Environment> frames;
+		for (const vector<Variable>* list : lists)
+			for (const Variable& var : *list)
+				var.countRefs(frames, young);
+		for (const vector<Variable>* list : lists)
+			for (const Variable& var : *list)
+				var.discountRefs(young);
+		for (const Environment& frame : frames)
+			frame.discountRefs(young);
+		for (const vector<Variable>* list : lists)
+			for (const Variable& var : *list)
+				if (var.isRoot())
+					mark(var);
+		for (const Environment& frame : frames)
+			if (frame.isRoot())
+				mark(frame);
+		for (const Environment& frame : frames)
+			frame.resetRefs();
+	}
+
+	// Collect young generation, objects tagged by incremental marking are kept. Young objects referenced
+	// from old objects have references from outside, so they are roots without a remembered set
+	void collectYoung()
+	{
+		#ifdef STATS
+		auto start = Clock::now();
+		#endif
+		markRoots({&youngList}, true, ScanYoung());
+		#ifdef STATS
+		std::chrono::duration<double> time = Clock::now() - start;
+		#endif
+		sweep(youngList, [](const Variable& var) {
+			return !var.isYoung() || (phase == PHASE_MARKING && var.isTagged(epoch));
+		});
+		#ifdef STATS
+		Statistic::markVariables(youngList.size(), time.count());
+		#endif
+		promote(youngList);
+	}
+
+	// Forget mutated code no longer referenced, return remaining
+	const vector<Variable>& pruneCode()
+	{
+		vector<Environment> frames;
+		for (const Variable& code : mutatedCode)
+			code.countRefs(frames, false);
+		mutatedCode.erase(std::remove_if(mutatedCode.begin(), mutatedCode.end(),
+			[](const Variable& code) { return !code.isRoot(); }), mutatedCode.end());
+		return mutatedCode;
+	}
+
+	// Collect both generations
+	void collectAll()
+	{
+		int tag = ++epoch;
+		#ifdef STATS
+		auto start = Clock::now();
+		#endif
+		if (markThreads > 1) {
+			GarbageCollector::MarkStack roots;
+			markRoots({&youngList, &oldList}, false, Push{tag, roots});
+			markParallel(tag, roots);
+		} else {
+			markRoots({&youngList, &oldList}, false, Scan{tag});
+		}
+		#ifdef STATS
+		std::chrono::duration<double> time = Clock::now() - start;
+		#endif
+		sweep(youngList, [tag](const Variable& var) { return var.isTagged(tag); });
+		sweep(oldList, [tag](const Variable& var) { return var.isTagged(tag); });
+		#ifdef STATS
+		Statistic::markVariables(youngList.size() + oldList.size(), time.count());
+		Statistic::markAll(youngList.size() + oldList.size(), time.count());
+		#endif
+		promote(youngList);
+		pruneCode();
+		fullThreshold = std::max(MIN_FULL_THRESHOLD, 2 * oldList.size());
+	}
+
+	// Start incremental marking, environment and mutated code are the only roots at top-level
+	void startMarking(const Environment& env)
+	{
+		fullPending = false;
+		condemned = oldList.size();
+		env.scan(++epoch, markStack);
+		for (const Variable& code : pruneCode()) {
+			markStack.push_back(&code.car());
+			markStack.push_back(&code.cdr());
+		}
+		phase = PHASE_MARKING;
+	}
+
+	// Sweep condemned objects until done or deadline, return whether done
+	bool sweepSlice(Clock::time_point deadline)
+	{
+		for (; swept < condemned; swept++) {
+			if (swept % CLOCK_INTERVAL == 0 && Clock::now() >= deadline)
+				return false;
+			Variable& var = oldList[swept];
+			if (var.isTagged(epoch))
+				oldList[alive++] = std::move(var);
+			else
+				release(var);
+		}
+		oldList.erase(oldList.begin() + alive, oldList.begin() + condemned);
+		return true;
+	}
+
+	// Run a slice of incremental collection
+	void collectSlice()
+	{
+		Clock::time_point deadline = Clock::now() + maxPause;
+		if (phase == PHASE_MARKING && drain(epoch, deadline)) {
+			phase = PHASE_SWEEPING;
+			swept = alive = 0;
+		}
+		if (phase == PHASE_SWEEPING && sweepSlice(deadline)) {
+			phase = PHASE_IDLE;
+			fullThreshold = std::max(MIN_FULL_THRESHOLD, 2 * oldList.size());
+		}
+		// Evaluation runs at least as long as the slice before next one
+		nextSlice = Clock::now() + maxPause;
+	}
+
+	// Collect young generation and start full collection once old generation has grown twice,
+	// incremental marking starts only at top-level where roots are known, so it's pending until then
+	void collect(const Environment* env)
+	{
+		collectYoung();
+		allocated = 0;
+		#ifdef STATS
+		Statistic::collectGarbage();
+		#endif
+		bool full = phase == PHASE_IDLE && oldList.size() > fullThreshold;
+		// Call running too long to reach top-level falls back to stop-the-world once old generation has grown twice more
+		bool stop = maxPause == Clock::duration::zero() || (!env && oldList.size() > 2 * fullThreshold);
+		fullPending = full && !stop && !env;
+		if (!full)
+			return;
+		if (stop)
+			collectAll();
+		else if (env)
+			startMarking(*env);
+	}
+
+	// Collect garbage if due, pending full collection is due at top-level whatever is allocated
+	void safePoint(const Environment* env)
+	{
+		bool slice = phase != PHASE_IDLE && Clock::now() >= nextSlice;
+		bool due = allocated >= budget || (env && fullPending);
+		if (!slice && !due)
+			return;
+		#ifdef STATS
+		auto start = Clock::now();
+		#endif
+		if (slice)
+			collectSlice();
+		if (due)
+			collect(env);
+		#ifdef STATS
+		std::chrono::duration<double> time = Clock::now() - start;
+		Statistic::pauseGarbage(time.count());
+		#endif
+	}
 }
 
 namespace GarbageCollector {
 
-	void trace(const Variable& var)
+	void trace(const Variable& var, size_t size)
 	{
-		traceList.push_back(var);
+		youngList.push_back(var);
+		allocated += size;
 		#ifdef STATS
 		Statistic::traceVariable();
 		#endif
 	}
 
-	void collect(Environment& env)
+	void allocate(size_t size)
 	{
-		int tag = rand();
-		env.scan(tag);
-		vector<Variable> aliveList;
-		for (const Variable& var : traceList)
-			if (*var.gcTag == tag) {
-				aliveList.push_back(var);
-			} else {
-				var.finalize();
-				#ifdef STATS
-				Statistic::finalizeVariable();
-				#endif
-			}
-		std::swap(aliveList, traceList);
+		allocated += size;
+	}
+
+	void setBudget(size_t size)
+	{
+		budget = size;
+	}
+
+	void setMaxPause(long microseconds)
+	{
+		maxPause = std::chrono::microseconds(microseconds);
+	}
+
+	void setMarkThreads(int count)
+	{
+		markThreads = std::max(1, count);
+	}
+
+	void writeBarrier(const Variable& var)
+	{
+		// Snapshot at beginning: value overwritten during marking is scanned, so that nothing reachable is missed
+		if (phase != PHASE_MARKING || var.isTagged(epoch))
+			return;
+		if (const Variable* next = var.scan(epoch, markStack))
+			markStack.push_back(next);
+	}
+
+	void immortalize(const Variable& code)
+	{
+		size_t base = markStack.size();
+		markStack.push_back(&code);
+		while (markStack.size() > base) {
+			const Variable* var = markStack.back();
+			markStack.pop_back();
+			// Optimization: cdr-chain is scanned in loop
+			while (var && var->isYoung())
+				var = var->immortalize(markStack);
+		}
+		// Immortal code is taken out of generations, it's freed by reference counting
+		#ifdef STATS
+		size_t size = youngList.size();
+		#endif
+		youngList.erase(std::remove_if(youngList.begin(), youngList.end(),
+			[](const Variable& var) { return var.isTagged(GarbageCollector::IMMORTAL); }), youngList.end());
+		#ifdef STATS
+		for (; size > youngList.size(); size--)
+			Statistic::finalizeVariable();
+		#endif
 	}
-}
\ No newline at end of file
+
+	void rememberCode(const Variable& code)
+	{
+		mutatedCode.push_back(code);
+	}
+
+	void safePoint()
+	{
+		::safePoint(nullptr);
+	}
+
+	void safePoint(const Environment& env)
+	{
+		::safePoint(&env);
+	}
+
+	size_t getHeapSize()
+	{
+		return youngList.size() + oldList.size();
+	}
+}
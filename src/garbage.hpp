@@ -6,33 +6,39 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 class Environment;
 class Variable;
 
 namespace GarbageCollector {
 
-	void trace(const Variable& var);
-	void collect(Environment& env);
-	
-}
-
-class GarbageObject
-{
-protected:
+	// Default bytes allocated between collections
+	const size_t DEFAULT_BUDGET = 1 << 20;
 
-	friend void GarbageCollector::collect(Environment& env);
+	// Values to be scanned in marking
+	using MarkStack = std::vector<const Variable*>;
 
-	// Tag for GC
-	std::shared_ptr<int> gcTag;
+	// Tags of code never collected, mutated code is tagged MUTATED
+	const int IMMORTAL = -1;
+	const int MUTATED = -2;
 
-public:
+	void trace(const Variable& var, size_t size);
+	void allocate(size_t size);
+	void setBudget(size_t size);
+	void setMaxPause(long microseconds);
+	void setMarkThreads(int count);
 
-	GarbageObject(): gcTag(std::make_shared<int>(0)) {}
+	// Snapshot-at-beginning barrier of incremental marking, called with value about to be overwritten.
+	// Old-to-young references need no barrier, since roots of minor collection are found by reference counts
+	void writeBarrier(const Variable& var);
 
-	// Finalize value
-	virtual void finalize() const {};
+	void immortalize(const Variable& code);
+	void rememberCode(const Variable& code);
+	void safePoint();
+	void safePoint(const Environment& env);
 
-	// Scan and tag value in using
-	virtual void scan(int tag) const {};
-};
\ No newline at end of file
+	// Count of objects in collected generations
+	size_t getHeapSize();
+	
+}
@@ -1,31 +1,43 @@
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 #include <readline/readline.h>
 #include "variable.hpp"
 #include "primitive.hpp"
 #include "evaluator.hpp"
+#include "vm.hpp"
 #include "exception.hpp"
 #include "statistic.hpp"
+#include "reader.hpp"
+#include "source.hpp"
+#include "fasl.hpp"
 
 using namespace std;
 
-int evaluator(istream& in, const string prompt = "")
+// Evaluate function of execution mode
+using EvalFunc = Variable (*)(const Variable&, Environment&);
+
+// Evaluate datums from read function, which returns false at end
+template <typename Read>
+int evaluator(Read read, EvalFunc evalFunc, const string prompt = "")
 {
 	int errorcnt = 0;
 	Variable var;
 	// Setup initial environment
 	Environment env = Primitive::setupEnvironment();
-	while (cout << prompt && in >> var) {
+	while (cout << prompt && read(var)) {
+		// Optimization: code is immortal, so that collections don't mark it again and again
+		GarbageCollector::immortalize(var);
 		try {
-			Variable ret = Evaluator::eval(var, env);
+			Variable ret = evalFunc(var, env);
 			if (ret != VAR_VOID)
 				cout << ret << endl;
 		} catch (Exception e) {
 			e.printStack();
 			errorcnt++;
 		}
-		// Collect garbage
-		GarbageCollector::collect(env);
+		// Collect garbage if due, environment is the only root here
+		GarbageCollector::safePoint(env);
 		// Print statistic information
 		#ifdef STATS
 		Statistic::printStatistic();
@@ -34,14 +46,86 @@ int evaluator(istream& in, const string prompt = "")
 	return errorcnt;
 }
 
+// Parse value of numeric option, throw invalid_argument unless whole text is a number in range
+template <typename Number>
+Number parseNumber(const string& text)
+{
+	size_t length = 0;
+	long long number;
+	try {
+		number = stoll(text, &length);
+	} catch (const out_of_range&) {
+		throw invalid_argument(text);
+	}
+	Number value = static_cast<Number>(number);
+	if (length != text.size() || static_cast<long long>(value) != number || (value < 0) != (number < 0))
+		throw invalid_argument(text);
+	return value;
+}
+
 int main(int argc, char const *argv[])
 {
-	if (argc > 1) {	// Read from file
-		ifstream fin(argv[1]);
-		return evaluator(fin);
-	} else {		// Read from cin
+	// Select execution mode and garbage collection options
+	EvalFunc evalFunc = Evaluator::eval;
+	bool cache = true;
+	int argi = 1;
+	for (; argi < argc && string(argv[argi]).compare(0, 2, "--") == 0; argi++) {
+		string option = argv[argi];
+		try {
+			if (option == "--vm") {
+				evalFunc = VM::eval;
+			} else if (option == "--no-cache") {
+				cache = false;
+			} else if (option == "--gc-budget" && argi + 1 < argc) {
+				GarbageCollector::setBudget(parseNumber<size_t>(argv[++argi]));
+			} else if (option == "--gc-pause" && argi + 1 < argc) {
+				GarbageCollector::setMaxPause(parseNumber<long>(argv[++argi]));
+			} else if (option == "--gc-threads" && argi + 1 < argc) {
+				GarbageCollector::setMarkThreads(parseNumber<int>(argv[++argi]));
+			} else {
+				cerr << "unknown option: " << option << endl;
+				return 1;
+			}
+		} catch (const invalid_argument&) {
+			cerr << "invalid value of option " << option << ": " << argv[argi] << endl;
+			return 1;
+		}
+	}
+	if (argc > argi) {	// Read from file
+		// Optimization: regular file is mapped into memory and read without copying
+		SourceFile source(argv[argi]);
+		if (source.isOpen() && cache) {
+			// Optimization: code is loaded from fasl cache if source is unchanged since it was written
+			string path = Fasl::cachePath(argv[argi]);
+			uint64_t hash = Fasl::hash(source.begin(), source.end());
+			Fasl::Loader loader(path, hash);
+			if (loader.isOpen())
+				return evaluator([&](Variable& var) { return loader.read(var); }, evalFunc);
+			// Datums are cached as they are read, before evaluation mutates them
+			Reader reader(source);
+			Fasl::Writer writer;
+			int errorcnt = evaluator([&](Variable& var) {
+				if (!reader.read(var))
+					return false;
+				writer.write(var);
+				return true;
+			}, evalFunc);
+			// Source with syntax error isn't cached, so that errors are reported again
+			if (reader.getErrors() == 0)
+				writer.save(path, hash);
+			return errorcnt;
+		}
+		if (source.isOpen()) {
+			Reader reader(source);
+			return evaluator([&](Variable& var) { return reader.read(var); }, evalFunc);
+		}
+		ifstream fin(argv[argi]);
+		Reader reader(fin);
+		return evaluator([&](Variable& var) { return reader.read(var); }, evalFunc);
+	} else {			// Read from cin
 		cout << "Welcome to Simple Scheme v0.1" << endl;
-		return evaluator(cin, ">");
+		Reader& reader = Reader::standard();
+		return evaluator([&](Variable& var) { return reader.read(var); }, evalFunc, ">");
 	}
 	return 0;
 }
@@ -0,0 +1,29 @@
+//
+// Pool allocator
+//
+// Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
+//
+#include "pool.hpp"
+
+// Pools are never destroyed, so that objects freed on exit still have their pool
+Pool* Pool::pools[MAX_SIZE / GRANULARITY + 1] = {};
+
+Pool::Pool(size_t size): size(size), used(0), freeList(nullptr) {}
+
+const Pool* Pool::find(size_t size)
+{
+	return size > MAX_SIZE ? nullptr : pools[(size + GRANULARITY - 1) / GRANULARITY];
+}
+
+void Pool::grow()
+{
+	char* slab = static_cast<char*>(::operator new(SLAB_SIZE));
+	slabs.push_back(slab);
+	// Slots are linked in address order, so that objects allocated in a row are packed together
+	size_t count = SLAB_SIZE / size;
+	for (size_t i = count; i-- > 0; ) {
+		Slot* slot = reinterpret_cast<Slot*>(slab + i * size);
+		slot->next = freeList;
+		freeList = slot;
+	}
+}
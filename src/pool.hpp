@@ -0,0 +1,90 @@
+//
+// Pool allocator
+//
+// Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <vector>
+
+// Optimization: objects are allocated from slabs segregated by size, freed slots are kept in a free list
+class Pool
+{
+public:
+
+	// Largest size pooled, larger objects are left to general allocator
+	static const size_t MAX_SIZE = 256;
+
+	// Sizes are rounded up to granularity
+	static const size_t GRANULARITY = 8;
+
+	// Bytes of a slab
+	static const size_t SLAB_SIZE = 64 * 1024;
+
+	// Allocate memory for object of size
+	static void* allocate(size_t size);
+
+	// Free memory of object of size, slot is reused by next allocation
+	static void free(void* ptr, size_t size);
+
+	// Get pool of size, null if nothing of the size has been allocated
+	static const Pool* find(size_t size);
+
+	// Statistic operations
+	size_t getSize() const { return size; }
+	size_t getUsed() const { return used; }
+	size_t getCapacity() const { return slabs.size() * (SLAB_SIZE / size); }
+	size_t getSlabs() const { return slabs.size(); }
+
+private:
+
+	// Free slot, linked in place
+	struct Slot
+	{
+		Slot* next;
+	};
+
+	// Pools indexed by size class, created on demand
+	static Pool* pools[MAX_SIZE / GRANULARITY + 1];
+
+	size_t size;				// Bytes of a slot
+	size_t used;				// Count of slots allocated
+	std::vector<char*> slabs;	// Slabs allocated
+	Slot* freeList;				// Free slots
+
+	// Constructor
+	explicit Pool(size_t size);
+
+	// Allocate a slab and link its slots into free list
+	void grow();
+};
+
+inline void* Pool::allocate(size_t size)
+{
+	if (size > MAX_SIZE)
+		return ::operator new(size);
+	Pool*& pool = pools[(size + GRANULARITY - 1) / GRANULARITY];
+	if (!pool)
+		pool = new Pool((size + GRANULARITY - 1) / GRANULARITY * GRANULARITY);
+	if (!pool->freeList)
+		pool->grow();
+	Slot* slot = pool->freeList;
+	pool->freeList = slot->next;
+	pool->used++;
+	return slot;
+}
+
+inline void Pool::free(void* ptr, size_t size)
+{
+	if (size > MAX_SIZE) {
+		::operator delete(ptr);
+		return;
+	}
+	Pool* pool = pools[(size + GRANULARITY - 1) / GRANULARITY];
+	Slot* slot = static_cast<Slot*>(ptr);
+	slot->next = pool->freeList;
+	pool->freeList = slot;
+	pool->used--;
+}
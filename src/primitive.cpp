@@ -8,12 +8,12 @@
 #include "evaluator.hpp"
 #include "primitive.hpp"
 #include "variable.hpp"
+#include "reader.hpp"
 #include "exception.hpp"
 
 #define BOOL_TO_VAR(exp)		((exp) ? VAR_TRUE : VAR_FALSE)
-#define FIRST_ARG(args)			((args).car())
-#define SECOND_ARG(args)		((args).cdr().car())
-#define REST_ARGS(args)			((args).cdr())
+#define FIRST_ARG(argv)			((argv)[0])
+#define SECOND_ARG(argv)		((argv)[1])
 
 using boost::multiprecision::cpp_rational;
 using namespace Evaluator;
@@ -23,133 +23,129 @@ namespace {
 
 	std::vector<Variable> prims = {
 
-		Variable("eq?", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("eq?", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return BOOL_TO_VAR(a == b);
 		}),
 
 		// Check operation
 
-		Variable("null?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isNull());
+		Variable("null?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isNull());
 		}),
 
-		Variable("number?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isNumber());
+		Variable("number?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isNumber());
 		}),
 
-		Variable("pair?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isPair());
+		Variable("pair?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isPair());
 		}),
 
-		Variable("string?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isString());
+		Variable("string?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isString());
 		}),
 
-		Variable("symbol?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isSymbol());
+		Variable("symbol?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isSymbol());
 		}),
 
-		Variable("integer?", [](const Variable& args, Environment &env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isInteger());
+		Variable("integer?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isInteger());
 		}),
 
 		// Arithemtic operations
 
-		Variable("+", [](const Variable& args, Environment &env)->Variable{
+		Variable("+", 0, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
 			Variable val = cpp_rational(0);
-			for (Variable it = args; !it.isNull(); it = it.cdr()) {
-				Variable a = it.car();
-				val = val + a;
-			}
+			for (int i = 0; i < argc; i++)
+				val = val + argv[i];
 			return val;
 		}),
 
-		Variable("*", [](const Variable& args, Environment &env)->Variable{
+		Variable("*", 0, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
 			Variable val = cpp_rational(1);
-			for (Variable it = args; !it.isNull(); it = it.cdr()) {
-				Variable a = it.car();
-				val = val * a;
-			}
+			for (int i = 0; i < argc; i++)
+				val = val * argv[i];
 			return val;
 		}),
 
-		Variable("-", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			if (REST_ARGS(args) == VAR_NULL)
+		Variable("-", 1, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			if (argc == 1)
 				return -a;
-			const Variable& b = SECOND_ARG(args);
+			const Variable& b = SECOND_ARG(argv);
 			return a-b;
 		}),
 
-		Variable("/", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("/", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return a/b;
 		}),
 
-		Variable("remainder", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("remainder", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return remainder(a,b);
 		}),
 
-		Variable("quotient", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("quotient", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return quotient(a,b);
 		}),
 
-		Variable("random", [](const Variable& args, Environment& env)->Variable{
+		Variable("random", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
 			const Variable& a = cpp_rational(rand());
-			const Variable& b = FIRST_ARG(args);
+			const Variable& b = FIRST_ARG(argv);
 			return remainder(a,b);
 		}),
 
-		Variable("gcd", [](const Variable& args, Environment& env)->Variable{
-			const Variable& a = cpp_rational(rand());
-			const Variable& b = FIRST_ARG(args);
+		Variable("gcd", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return gcd(a,b);
 		}),
 
-		Variable("even?", [](const Variable& args, Environment& env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isEven());
+		Variable("even?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isEven());
 		}),
 
-		Variable("odd?", [](const Variable& args, Environment& env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args).isOdd());
+		Variable("odd?", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv).isOdd());
 		}),
 
 		// Compare operations
 
-		Variable("<", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("<", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return BOOL_TO_VAR(a<b);
 		}),
 
-		Variable(">", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable(">", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return BOOL_TO_VAR(a>b);
 		}),
 
-		Variable("<=", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("<=", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return BOOL_TO_VAR(a<=b);
 		}),
 
-		Variable(">=", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable(">=", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return BOOL_TO_VAR(a>=b);
 		}),
 
-		Variable("=", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("=", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			a.requireType("=", Variable::TYPE_NUMBER);
 			b.requireType("=", Variable::TYPE_NUMBER);
 			return BOOL_TO_VAR(a==b);
@@ -157,175 +153,178 @@ namespace {
 
 		// Logical operations
 
-		Variable("not", [](const Variable& args, Environment& env)->Variable{
-			return BOOL_TO_VAR(FIRST_ARG(args) == VAR_FALSE);
+		Variable("not", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return BOOL_TO_VAR(FIRST_ARG(argv) == VAR_FALSE);
 		}),
 
 		// Pair operations
 
-		Variable("cons", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("cons", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			return Variable(a, b);
 		}),
 
-		Variable("set-car!", [](const Variable& args, Environment& env)->Variable{
-			const Variable& pair = FIRST_ARG(args);
-			const Variable& car = SECOND_ARG(args);
+		Variable("set-car!", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& pair = FIRST_ARG(argv);
+			const Variable& car = SECOND_ARG(argv);
 			return pair.setCar(car);
 		}),
 
-		Variable("set-cdr!", [](const Variable& args, Environment& env)->Variable{
-			const Variable& pair = FIRST_ARG(args);
-			const Variable& cdr = SECOND_ARG(args);
+		Variable("set-cdr!", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& pair = FIRST_ARG(argv);
+			const Variable& cdr = SECOND_ARG(argv);
 			return pair.setCdr(cdr);
 		}),
 
-		Variable("car", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car();
+		Variable("car", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car();
 		}),
 
-		Variable("caar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car();
+		Variable("caar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car();
 		}),
 
-		Variable("caaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().car();
+		Variable("caaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().car();
 		}),
 
-		Variable("caaaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().car().car();
+		Variable("caaaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().car().car();
 		}),
 
-		Variable("caaadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().car().cdr();
+		Variable("caaadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().car().cdr();
 		}),
 
-		Variable("caadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().cdr();
+		Variable("caadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().cdr();
 		}),
 
-		Variable("caadar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().cdr().car();
+		Variable("caadar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().cdr().car();
 		}),
 
-		Variable("caaddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().car().cdr().cdr();
+		Variable("caaddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().car().cdr().cdr();
 		}),
 
-		Variable("cadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr();
+		Variable("cadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr();
 		}),
 
-		Variable("cadar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().car();
+		Variable("cadar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().car();
 		}),
 
-		Variable("cadaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().car().car();
+		Variable("cadaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().car().car();
 		}),
 
-		Variable("cadadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().car().cdr();
+		Variable("cadadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().car().cdr();
 		}),
 
-		Variable("caddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().cdr();
+		Variable("caddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().cdr();
 		}),
 
-		Variable("caddar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().cdr().car();
+		Variable("caddar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().cdr().car();
 		}),
 
-		Variable("cadddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).car().cdr().cdr().cdr();
+		Variable("cadddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).car().cdr().cdr().cdr();
 		}),
 
-		Variable("cdr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr();
+		Variable("cdr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr();
 		}),
 
-		Variable("cdar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car();
+		Variable("cdar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car();
 		}),
 
-		Variable("cdaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().car();
+		Variable("cdaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().car();
 		}),
 
-		Variable("cdaaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().car().car();
+		Variable("cdaaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().car().car();
 		}),
 
-		Variable("cdaadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().car().cdr();
+		Variable("cdaadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().car().cdr();
 		}),
 
-		Variable("cdadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().cdr();
+		Variable("cdadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().cdr();
 		}),
 
-		Variable("cdadar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().cdr().car();
+		Variable("cdadar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().cdr().car();
 		}),
 
-		Variable("cdaddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().car().cdr().cdr();
+		Variable("cdaddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().car().cdr().cdr();
 		}),
 
-		Variable("cddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr();
+		Variable("cddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr();
 		}),
 
-		Variable("cddar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().car();
+		Variable("cddar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().car();
 		}),
 
-		Variable("cddaar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().car().car();
+		Variable("cddaar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().car().car();
 		}),
 
-		Variable("cddadr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().car().cdr();
+		Variable("cddadr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().car().cdr();
 		}),
 
-		Variable("cdddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().cdr();
+		Variable("cdddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().cdr();
 		}),
 
-		Variable("cdddar", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().cdr().car();
+		Variable("cdddar", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().cdr().car();
 		}),
 
-		Variable("cddddr", [](const Variable& args, Environment& env)->Variable{
-			return FIRST_ARG(args).cdr().cdr().cdr().cdr();
+		Variable("cddddr", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return FIRST_ARG(argv).cdr().cdr().cdr().cdr();
 		}),
 
 		// String operations
 
-		Variable("number->string", [](const Variable& args, Environment& env)->Variable{
-			const Variable num = FIRST_ARG(args);
+		Variable("number->string", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable num = FIRST_ARG(argv);
 			return Variable(num.toString(), Variable::TYPE_STRING);
 		}),
 
 		// List operations
 
-		Variable("list", [](const Variable& args, Environment& env)->Variable{
-			return args;
+		Variable("list", 0, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
+			Variable val = VAR_NULL;
+			for (int i = argc - 1; i >= 0; i--)
+				val = Variable(argv[i], std::move(val));
+			return val;
 		}),
 
-		Variable("length", [](const Variable& args, Environment& env)->Variable{
+		Variable("length", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
 			cpp_rational count = 0;
-			for (Variable it = FIRST_ARG(args); it != VAR_NULL; it = it.cdr())
+			for (Variable it = FIRST_ARG(argv); it != VAR_NULL; it = it.cdr())
 				count++;
 			return Variable(count);
 		}),
 
-		Variable("append", [](const Variable &args, Environment &env)->Variable{
+		Variable("append", 0, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
 			const Variable& head = Variable(VAR_NULL, VAR_NULL);
 			Variable tail = head;
-			for (Variable it = args; it != VAR_NULL; it = it.cdr()) {
-				const Variable& li = it.car();
+			for (int i = 0; i < argc; i++) {
+				const Variable& li = argv[i];
 				if (li != VAR_NULL) {
 					tail.setCdr(li);
 					while (tail.cdr() != VAR_NULL)
@@ -335,12 +334,10 @@ namespace {
 			return head.cdr();
 		}),
 
-		Variable("map", [](const Variable &args, Environment &env)->Variable{
-			Variable proc = args.car();
-			// Get arguments
-			list<Variable> argss;
-			for (Variable it = args.cdr(); it != VAR_NULL; it = it.cdr())
-				argss.push_back(it.car());
+		Variable("map", 2, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
+			// Arguments are copied before applying, stack may be reused
+			Variable proc = argv[0];
+			list<Variable> argss(argv + 1, argv + argc);
 			// Apply
 			Variable resultHead = Variable(VAR_NULL, VAR_NULL);
 			Variable resultTail = resultHead;
@@ -371,55 +368,62 @@ namespace {
 
 		// I/O procedure
 
-		Variable("display", [](const Variable& args, Environment& env)->Variable{
-			std::cout << FIRST_ARG(args);
+		Variable("display", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			std::cout << FIRST_ARG(argv);
 			return VAR_VOID;
 		}),
 
-		Variable("newline", [](const Variable& args, Environment& env)->Variable{
+		Variable("newline", 0, 0, [](int argc, const Variable* argv, Environment& env)->Variable{
 			std::cout << std::endl;
 			return VAR_VOID;
 		}),
 
-		Variable("read", [](const Variable& args, Environment& env)->Variable{
+		Variable("read", 0, 0, [](int argc, const Variable* argv, Environment& env)->Variable{
 			Variable val = VAR_NULL;
-			if (std::cin >> val)
+			if (Reader::standard().read(val))
 				return val;
 			throw Exception("read: end of file");
 		}),
 
-		Variable("error", [](const Variable& args, Environment& env)->Variable{
+		Variable("error", 0, Variable::VARIADIC, [](int argc, const Variable* argv, Environment& env)->Variable{
 			std::string msg;
-			for (Variable it = args; !it.isNull(); it = it.cdr())
-				msg += it.car().toString();
+			for (int i = 0; i < argc; i++)
+				msg += argv[i].toString();
 			throw Exception(msg);
 		}),
 
 		// Debug procedure
 
-		Variable("assert", [](const Variable& args, Environment& env)->Variable{
-			const Variable& a = FIRST_ARG(args);
+		Variable("assert", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
 			if (a == VAR_FALSE)
 				throw Exception(string("assert:") + a.toString() + " isn't true");
 			return VAR_VOID;
 		}),
 
-		Variable("assert=", [](const Variable& args, Environment &env)->Variable{
-			const Variable& a = FIRST_ARG(args);
-			const Variable& b = SECOND_ARG(args);
+		Variable("assert=", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			const Variable& a = FIRST_ARG(argv);
+			const Variable& b = SECOND_ARG(argv);
 			if (a != b)
 				throw Exception(string("assert:") + a.toString() + " != " + b.toString());
 			return VAR_VOID;
 		}),
 
+		Variable("heap-size", 0, 0, [](int argc, const Variable* argv, Environment& env)->Variable{
+			return Variable(static_cast<long>(GarbageCollector::getHeapSize()));
+		}),
+
 		// Advanced procedure
 
-		Variable("eval", [](const Variable& args, Environment& env)->Variable{
-			return Evaluator::eval(FIRST_ARG(args), env);
+		Variable("eval", 1, 1, [](int argc, const Variable* argv, Environment& env)->Variable{
+			Variable exp = FIRST_ARG(argv);
+			return Evaluator::eval(exp, env);
 		}),
 
-		Variable("apply", [](const Variable& args, Environment& env)->Variable{
-			return Evaluator::apply(FIRST_ARG(args), SECOND_ARG(args), env);
+		Variable("apply", 2, 2, [](int argc, const Variable* argv, Environment& env)->Variable{
+			Variable proc = FIRST_ARG(argv);
+			Variable args = SECOND_ARG(argv);
+			return Evaluator::apply(proc, args, env);
 		})
 	};
 
@@ -430,7 +434,7 @@ namespace Primitive {
 	// Setup a base environment
 	Environment setupEnvironment()
 	{
-		Environment env;
+		Environment env = Environment(VAR_NULL, VAR_NULL);
 		// add constant 
 		env.defineVariable("true", VAR_TRUE);
 		env.defineVariable("false", VAR_FALSE);
@@ -0,0 +1,312 @@
+//
+// Scheme reader
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include "reader.hpp"
+
+using boost::multiprecision::cpp_rational;
+
+namespace {
+
+	// Char delimits atom
+	bool isDelimiter(int c)
+	{
+		switch (c) {
+			case EOF: case ' ': case '\t': case '\r': case '\n':
+			case '(': case ')': case '\'': case '"': case ';':
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Skip digits from position, return position after them
+	const char* skipDigits(const char* p, const char* end)
+	{
+		while (p < end && isdigit(static_cast<unsigned char>(*p)))
+			p++;
+		return p;
+	}
+
+	// Match -?digits, return position after it or null
+	const char* matchInteger(const char* p, const char* end)
+	{
+		if (p < end && *p == '-')
+			p++;
+		const char* digits = skipDigits(p, end);
+		return digits > p ? digits : nullptr;
+	}
+
+	// Match -?digits(/digits)?
+	bool isRational(const char* p, const char* end)
+	{
+		p = matchInteger(p, end);
+		if (p && p < end && *p == '/') {
+			const char* digits = skipDigits(p + 1, end);
+			p = digits > p + 1 ? digits : nullptr;
+		}
+		return p == end;
+	}
+
+	// Match -?digits(.digits)?([eE]-?digits)?
+	bool isDouble(const char* p, const char* end)
+	{
+		p = matchInteger(p, end);
+		if (p && p < end && *p == '.') {
+			const char* digits = skipDigits(p + 1, end);
+			p = digits > p + 1 ? digits : nullptr;
+		}
+		if (p && p < end && (*p == 'e' || *p == 'E'))
+			p = matchInteger(p + 1, end);
+		return p == end;
+	}
+
+	// Parse -?digits into machine word by decimal loop, return false on overflow
+	bool parseWord(const char* p, const char* end, long& value)
+	{
+		bool negative = *p == '-';
+		value = 0;
+		for (p += negative; p < end; p++) {
+			long digit = *p - '0';
+			// Negative literal is accumulated downwards, so that the minimum is reached
+			if (__builtin_mul_overflow(value, 10, &value)
+				|| (negative ? __builtin_sub_overflow(value, digit, &value)
+					: __builtin_add_overflow(value, digit, &value)))
+				return false;
+		}
+		return true;
+	}
+
+	// Match digits after slash that are all zero, such literal is no rational
+	bool hasZeroDenominator(const char* begin, const char* end)
+	{
+		const char* slash = static_cast<const char*>(memchr(begin, '/', end - begin));
+		if (!slash)
+			return false;
+		for (const char* p = slash + 1; p < end; p++)
+			if (*p != '0')
+				return false;
+		return true;
+	}
+
+	// Optimization: literal fitting in machine word is parsed without cpp_int, long literal is left to cpp_rational
+	Variable makeRational(const char* begin, const char* end)
+	{
+		const char* slash = static_cast<const char*>(memchr(begin, '/', end - begin));
+		long num, den = 1;
+		if (parseWord(begin, slash ? slash : end, num)
+			&& (!slash || parseWord(slash + 1, end, den))) {
+			if (num % den == 0)
+				return Variable(num / den);
+			// Exact ratio is normalized once by cpp_rational
+			return Variable(cpp_rational(num, den));
+		}
+		return Variable(std::string(begin, end), Variable::TYPE_RATIONAL);
+	}
+
+	// Double is converted from copy on stack, since view of source file isn't terminated
+	Variable makeDouble(const char* begin, const char* end)
+	{
+		char buffer[64];
+		size_t length = end - begin;
+		if (length >= sizeof(buffer))
+			return Variable(std::string(begin, end), Variable::TYPE_FLOAT);
+		memcpy(buffer, begin, length);
+		buffer[length] = '\0';
+		return Variable(strtod(buffer, nullptr));
+	}
+}
+
+Reader::Reader(std::istream& in):
+	in(&in), buf(in.rdbuf()), source(nullptr), atom(nullptr), length(0), depth(0), errors(0), quote(Variable::createSymbol("quote")) {}
+
+Reader::Reader(SourceFile& source):
+	in(nullptr), buf(&source), source(&source), atom(nullptr), length(0), depth(0), errors(0), quote(Variable::createSymbol("quote")) {}
+
+int Reader::skip()
+{
+	for (;;) {
+		int c = buf->sgetc();
+		switch (c) {
+			case ' ': case '\t': case '\r': case '\n':
+				buf->sbumpc();
+				break;
+			case ';':
+				// Line comment
+				while (c != EOF && c != '\n')
+					c = buf->snextc();
+				break;
+			case '#':
+				// Block comment, otherwise # starts an atom
+				if (buf->snextc() != '|')
+					return '#';
+				for (c = buf->snextc(); c != EOF; ) {
+					c = buf->sbumpc();
+					if (c == '|' && buf->sgetc() == '#') {
+						buf->sbumpc();
+						break;
+					}
+				}
+				break;
+			default:
+				return c;
+		}
+	}
+}
+
+void Reader::readAtom(bool hash)
+{
+	// Hash consumed is right before position in source file
+	const char* begin = source ? source->position() - hash : nullptr;
+	text = hash ? "#" : "";
+	for (int c = buf->sgetc(); !isDelimiter(c); c = buf->snextc())
+		if (!source)
+			text.push_back(c);
+	setText(begin, source ? source->position() : nullptr);
+}
+
+bool Reader::readString()
+{
+	const char* begin = source ? source->position() : nullptr;
+	text.clear();
+	for (int c = buf->sbumpc(); c != '"'; c = buf->sbumpc()) {
+		if (c == EOF)
+			return false;
+		// Escaped quote is kept as it is
+		if (c == '\\' && buf->sgetc() == '"') {
+			if (!source)
+				text.push_back(c);
+			c = buf->sbumpc();
+		}
+		if (!source)
+			text.push_back(c);
+	}
+	// Closing quote is excluded
+	setText(begin, source ? source->position() - 1 : nullptr);
+	return true;
+}
+
+// Optimization: text of source file is a view into mapped bytes, copied only when it is interned or boxed
+void Reader::setText(const char* begin, const char* end)
+{
+	if (source) {
+		atom = begin;
+		length = end - begin;
+	} else {
+		atom = text.data();
+		length = text.size();
+	}
+}
+
+void Reader::open(bool quote)
+{
+	if (depth == frames.size())
+		frames.emplace_back();
+	Frame& frame = frames[depth++];
+	frame.quote = quote;
+	frame.dotted = false;
+	frame.tailed = false;
+	frame.items.clear();
+	frame.tail = VAR_NULL;
+}
+
+void Reader::error(const std::string& msg)
+{
+	std::cerr << "syntax error: " << msg << std::endl;
+	depth = 0;
+	errors++;
+}
+
+// Optimization: lists are built by loop with frames instead of recursion
+bool Reader::read(Variable& var)
+{
+	depth = 0;
+	for (;;) {
+		Variable datum = VAR_NULL;
+		int c = skip();
+		switch (c) {
+			case EOF:
+				if (depth > 0)
+					error("unexpected end of file");
+				if (in)
+					in->setstate(std::ios::eofbit);
+				return false;
+			case '(':
+				buf->sbumpc();
+				open(false);
+				continue;
+			case '\'':
+				buf->sbumpc();
+				open(true);
+				continue;
+			case ')': {
+				buf->sbumpc();
+				if (depth == 0 || frames[depth - 1].quote || frames[depth - 1].dotted != frames[depth - 1].tailed) {
+					error("unexpected )");
+					continue;
+				}
+				Frame& frame = frames[--depth];
+				datum = std::move(frame.tail);
+				for (size_t i = frame.items.size(); i-- > 0; )
+					datum = Variable(std::move(frame.items[i]), std::move(datum));
+				break;
+			}
+			case '"':
+				buf->sbumpc();
+				if (!readString()) {
+					error("unterminated string");
+					continue;
+				}
+				datum = Variable(std::string(atom, length), Variable::TYPE_STRING);
+				break;
+			default:
+				// Hash has been consumed by skip
+				readAtom(c == '#');
+				if (length == 1 && *atom == '.') {
+					if (depth == 0 || frames[depth - 1].quote || frames[depth - 1].dotted || frames[depth - 1].items.empty())
+						error("unexpected .");
+					else
+						frames[depth - 1].dotted = true;
+					continue;
+				}
+				if (isRational(atom, atom + length)) {
+					if (hasZeroDenominator(atom, atom + length)) {
+						error("zero denominator in " + std::string(atom, length));
+						continue;
+					}
+					datum = makeRational(atom, atom + length);
+				} else if (isDouble(atom, atom + length))
+					datum = makeDouble(atom, atom + length);
+				else
+					datum = Variable::createSymbol(atom, length);
+		}
+		// Wrap datum by quotes waiting for it
+		while (depth > 0 && frames[depth - 1].quote) {
+			datum = Variable(quote, Variable(std::move(datum), VAR_NULL));
+			depth--;
+		}
+		if (depth == 0) {
+			var = std::move(datum);
+			return true;
+		}
+		Frame& frame = frames[depth - 1];
+		if (!frame.dotted) {
+			frame.items.push_back(std::move(datum));
+		} else if (!frame.tailed) {
+			frame.tail = std::move(datum);
+			frame.tailed = true;
+		} else {
+			error("more than one datum after .");
+		}
+	}
+}
+
+Reader& Reader::standard()
+{
+	static Reader reader(std::cin);
+	return reader;
+}
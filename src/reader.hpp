@@ -0,0 +1,75 @@
+//
+// Scheme reader
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "variable.hpp"
+#include "source.hpp"
+
+// Reader of datums from a stream, states are held by reader so that readers are independent
+class Reader
+{
+public:
+
+	// Constructor, datums are read from stream
+	explicit Reader(std::istream& in);
+
+	// Constructor, datums are read from mapped source file
+	explicit Reader(SourceFile& source);
+
+	// Read a datum, return false at end of file
+	bool read(Variable& var);
+
+	// Count of syntax errors met
+	size_t getErrors() const { return errors; }
+
+	// Reader of standard input, shared by REPL and read primitive
+	static Reader& standard();
+
+private:
+
+	// List or quote being read
+	struct Frame
+	{
+		bool quote;						// Is quote waiting for datum?
+		bool dotted;					// Is dot read?
+		bool tailed;					// Is datum after dot read?
+		std::vector<Variable> items;	// Items read
+		Variable tail;					// Datum after dot, null if none
+		Frame(): quote(false), dotted(false), tailed(false), tail(VAR_NULL) {}
+	};
+
+	std::istream* in;				// Stream to read, null if source file is read
+	std::streambuf* buf;			// Buffer of stream or source file, read char by char
+	const SourceFile* source;		// Source file to read, null if stream is read
+	std::string text;				// Text copied from stream
+	const char* atom;				// Text of atom or string read, view into source file or text
+	size_t length;					// Length of atom or string read
+	std::vector<Frame> frames;		// Optimization: frames are kept to reuse items
+	size_t depth;					// Count of frames in using
+	size_t errors;					// Count of syntax errors
+	Variable quote;					// Symbol quote
+
+	// Skip whitespace and comments, return next char
+	int skip();
+
+	// Read text of atom, hash has been read if prefixed
+	void readAtom(bool hash);
+
+	// Read string, opening quote has been read
+	bool readString();
+
+	// Set text read, begin is the start of view into source file
+	void setText(const char* begin, const char* end);
+
+	// Open a frame for list or quote
+	void open(bool quote);
+
+	// Print syntax error and discard datum being read
+	void error(const std::string& msg);
+};
@@ -0,0 +1,42 @@
+//
+// Source file mapped into memory
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.hpp"
+
+SourceFile::SourceFile(const std::string& path): data(nullptr), size(0), opened(false)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	// Pipes and devices can't be mapped
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		size = st.st_size;
+		if (size == 0) {
+			opened = true;
+		} else {
+			void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED) {
+				data = static_cast<char*>(ptr);
+				madvise(ptr, size, MADV_SEQUENTIAL);
+				opened = true;
+			}
+		}
+	}
+	close(fd);
+	// Whole file is the get area, so that underflow is only met at end of file
+	if (opened)
+		setg(data, data, data + size);
+}
+
+SourceFile::~SourceFile()
+{
+	if (data)
+		munmap(data, size);
+}
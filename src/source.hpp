@@ -0,0 +1,41 @@
+//
+// Source file mapped into memory
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <string>
+#include <streambuf>
+
+// Optimization: source file is mapped into memory and read as buffer of stream, no bytes are copied
+class SourceFile: public std::streambuf
+{
+public:
+
+	// Constructor, file is mapped if it is a regular file
+	explicit SourceFile(const std::string& path);
+
+	// Destructor, file is unmapped
+	~SourceFile();
+
+	// Is file mapped? Otherwise it should be read by stream
+	bool isOpen() const { return opened; }
+
+	// Position of next char in mapped bytes
+	const char* position() const { return gptr(); }
+
+	// Mapped bytes of whole file
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+
+private:
+
+	char* data;			// Mapped bytes, null if file is empty
+	size_t size;		// Bytes of file
+	bool opened;		// Is file mapped?
+
+	// Mapping is owned, so that it can't be copied
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+};
@@ -4,6 +4,7 @@
 // Author: ZhangZhenghao(zhangzhenghao@hotmail.com)
 // 
 #include "statistic.hpp"
+#include "pool.hpp"
 
 using namespace std;
 
@@ -12,7 +13,16 @@ namespace {
 	int varCreated = 0;
 	int varDestroyed = 0;
 	int varCopyed = 0;
+	int varMoved = 0;
 	int varTraced = 0;
+	int gcCount = 0;
+	int varMarked = 0;
+	double markTime = 0;
+	int varMarkedAll = 0;
+	double markAllTime = 0;
+	int pauseCount = 0;
+	double pauseTime = 0;
+	double pauseMaxTime = 0;
 	int stackDepth = 0;
 	int stackMaxDepth = 0;
 
@@ -35,6 +45,11 @@ namespace Statistic {
 		varCopyed++;
 	}
 
+	void moveVariable()
+	{
+		varMoved++;
+	}
+
 	void traceVariable()
 	{
 		varTraced++;
@@ -45,6 +60,32 @@ namespace Statistic {
 		varTraced--;
 	}
 
+	void collectGarbage()
+	{
+		gcCount++;
+	}
+
+	void markVariables(int count, double time)
+	{
+		varMarked += count;
+		markTime += time;
+	}
+
+	void markAll(int count, double time)
+	{
+		varMarkedAll += count;
+		markAllTime += time;
+	}
+
+	void pauseGarbage(double time)
+	{
+		pauseCount++;
+		pauseTime += time;
+		if (time > pauseMaxTime)
+			pauseMaxTime = time;
+		clog << "\x1B[1;33mgarbage pause (us) " << time * 1e6 << "\x1B[0m" << endl;
+	}
+
 	void applyStart()
 	{
 		stackDepth++;
@@ -61,10 +102,25 @@ namespace Statistic {
 	{
 		clog << "\x1B[1;33mvariale created   " << varCreated << endl;
 		clog << "variale copyed    " << varCopyed << endl;
+		clog << "variale moved     " << varMoved << endl;
 		clog << "variale destroyed " << varDestroyed << endl;
 		clog << "variale alive     " << varCreated - varDestroyed << endl;
 		clog << "variale traced    " << varTraced << endl;
-		clog << "max stack depth   " << stackMaxDepth << "\x1B[0m" << endl;
+		clog << "garbage collected " << gcCount << endl;
+		clog << "mark time (ns)    " << (varMarked ? markTime * 1e9 / varMarked : 0) << " per variable" << endl;
+		clog << "full mark (ns)    " << (varMarkedAll ? markAllTime * 1e9 / varMarkedAll : 0) << " per variable" << endl;
+		clog << "pause time (us)   " << (pauseCount ? pauseTime * 1e6 / pauseCount : 0) << " average, " << pauseMaxTime * 1e6 << " max" << endl;
+		clog << "max stack depth   " << stackMaxDepth << endl;
+		// Occupancy is slots in use, fragmentation is slabs that could be freed if objects were compacted
+		for (size_t size = Pool::GRANULARITY; size <= Pool::MAX_SIZE; size += Pool::GRANULARITY)
+			if (const Pool* pool = Pool::find(size)) {
+				size_t perSlab = Pool::SLAB_SIZE / size;
+				size_t needed = (pool->getUsed() + perSlab - 1) / perSlab;
+				clog << "pool " << size << " bytes     " << pool->getUsed() << "/" << pool->getCapacity() << " slots, "
+					<< 100.0 * pool->getUsed() / pool->getCapacity() << "% occupancy, "
+					<< 100.0 * (pool->getSlabs() - needed) / pool->getSlabs() << "% fragmentation" << endl;
+			}
+		clog << "\x1B[0m";
 	}
 
 }
\ No newline at end of file
@@ -12,8 +12,13 @@ namespace Statistic {
 	void createVariable();
 	void destroyVariable();
 	void copyVariable();
+	void moveVariable();
 	void traceVariable();
 	void finalizeVariable();
+	void collectGarbage();
+	void markVariables(int count, double time);
+	void markAll(int count, double time);
+	void pauseGarbage(double time);
 	void printStatistic();
 	void applyStart();
 	void applyEnd();
@@ -0,0 +1,155 @@
+//
+// Scheme Syntax
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#include <vector>
+#include "syntax.hpp"
+
+using namespace std;
+
+namespace {
+
+	using Syntax::Form;
+
+	// Build jump table from symbol ID to special form
+	vector<Form> buildForms()
+	{
+		const pair<string, Form> specials[] = {
+			{"quote", Syntax::FORM_QUOTE},
+			{"define", Syntax::FORM_DEFINE},
+			{"set!", Syntax::FORM_ASSIGNMENT},
+			{"begin", Syntax::FORM_SEQ},
+			{"lambda", Syntax::FORM_LAMBDA},
+			{"and", Syntax::FORM_AND},
+			{"or", Syntax::FORM_OR},
+			{"if", Syntax::FORM_IF},
+			{"cond", Syntax::FORM_COND},
+			{"else", Syntax::FORM_ELSE},
+			{"let", Syntax::FORM_LET}
+		};
+		vector<Form> forms;
+		for (const auto& special : specials) {
+			size_t id = Variable::createSymbol(special.first).getSymbolId();
+			if (id >= forms.size())
+				forms.resize(id + 1, Syntax::FORM_APPLICATION);
+			forms[id] = special.second;
+		}
+		return forms;
+	}
+
+	// Optimization: special forms are interned before any source is read
+	const vector<Form> forms = buildForms();
+
+	// Declare symbol in layout
+	void declare(Environment::Layout& layout, const Variable& var)
+	{
+		var.requireType("define", Variable::TYPE_SYMBOL);
+		int id = var.getSymbolId();
+		for (int bound : layout)
+			if (bound == id)
+				return;
+		layout.push_back(id);
+	}
+
+	// Declare internal definitions of frame, nested lambda bodies excluded
+	void scanDefines(const Variable& expr, Environment::Layout& layout)
+	{
+		switch (Syntax::formOf(expr)) {
+			case Syntax::FORM_NONE:
+			case Syntax::FORM_QUOTE:
+			case Syntax::FORM_LAMBDA:
+				return;
+			case Syntax::FORM_DEFINE:
+				if (IS_DEFINE_PROC(expr)) {
+					declare(layout, DEFINE_PROC_NAME(expr));
+				} else {
+					declare(layout, DEFINE_VAR_NAME(expr));
+					scanDefines(DEFINE_VAR_VAL(expr), layout);
+				}
+				return;
+			case Syntax::FORM_LET:
+				for (const Variable* it = &LET_BINDINGS(expr); !it->isNull(); it = &it->cdr())
+					scanDefines(BINDING_VAL(it->car()), layout);
+				return;
+			default:
+				for (const Variable* it = &expr; !it->isNull(); it = &it->cdr())
+					scanDefines(it->car(), layout);
+		}
+	}
+
+}
+
+namespace Syntax {
+
+	// Get form of expression
+	Form formOf(const Variable& expr)
+	{
+		if (!expr.isPair())
+			return FORM_NONE;
+		const Variable& tag = expr.car();
+		if (!tag.isSymbol())
+			return FORM_APPLICATION;
+		// Special forms are pinned, so that a reused ID of other symbol is never one of them
+		size_t id = tag.peekSymbolId();
+		return id < forms.size() ? forms[id] : FORM_APPLICATION;
+	}
+
+}
+
+namespace Syntax {
+
+	// Constructor for frames of environment
+	Resolver::Resolver(const Environment& env)
+	{
+		for (Environment envIt = env; !envIt.isGlobal(); envIt = envIt.getEncloseEnv())
+			scopes.insert(scopes.begin(), std::make_shared<Layout>(envIt.getLayout()));
+	}
+
+	// Enter frame, internal definitions of body get slots after bound variables
+	shared_ptr<const Resolver::Layout> Resolver::enter(shared_ptr<Layout> layout, const Variable& body)
+	{
+		for (const Variable* it = &body; !it->isNull(); it = &it->cdr())
+			scanDefines(it->car(), *layout);
+		scopes.push_back(layout);
+		return layout;
+	}
+
+	// Enter frame of procedure
+	shared_ptr<const Resolver::Layout> Resolver::enterLambda(const Variable& args, const Variable& body)
+	{
+		auto layout = make_shared<Layout>();
+		for (const Variable* it = &args; !it->isNull(); it = &it->cdr())
+			layout->push_back(it->car().getSymbolId());
+		return enter(layout, body);
+	}
+
+	// Enter frame of let
+	shared_ptr<const Resolver::Layout> Resolver::enterLet(const Variable& bindings, const Variable& body)
+	{
+		auto layout = make_shared<Layout>();
+		for (const Variable* it = &bindings; !it->isNull(); it = &it->cdr())
+			layout->push_back(BINDING_VAR(it->car()).getSymbolId());
+		return enter(layout, body);
+	}
+
+	// Leave frame
+	void Resolver::leave()
+	{
+		scopes.pop_back();
+	}
+
+	// Resolve variable into depth and slot, false if global
+	bool Resolver::resolve(const Variable& var, int& depth, int& slot) const
+	{
+		int id = var.getSymbolId();
+		for (depth = 0; depth < (int) scopes.size(); depth++) {
+			const Layout& layout = *scopes[scopes.size() - depth - 1];
+			for (slot = 0; slot < (int) layout.size(); slot++)
+				if (layout[slot] == id)
+					return true;
+		}
+		return false;
+	}
+
+}
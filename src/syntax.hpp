@@ -0,0 +1,117 @@
+//
+// Scheme Syntax
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "variable.hpp"
+
+// Macro for syntax
+
+#define TAGGED_LIST(exp, form)	(Syntax::formOf(exp) == (form))
+// BOOL
+#define IS_TRUE(exp)			((exp) != VAR_FALSE)
+#define IS_FALSE(exp)			((exp) == VAR_FALSE)
+// SELF EVALUATING
+#define IS_SELF_EVALUATING(exp)	((exp).isNumber() || (exp).isString())
+// VARIABLE
+#define IS_VARIABLE(exp)		((exp).isSymbol())
+// QUOTED
+#define QUOTED(exp)				((exp).cdr().car())
+// DEFINE
+#define IS_DEFINE_PROC(exp)		((exp).cdr().car().isPair())
+#define DEFINE_VAR_NAME(exp)	((exp).cdr().car())
+#define DEFINE_VAR_VAL(exp)		((exp).cdr().cdr().car())
+#define DEFINE_PROC_NAME(exp)	((exp).cdr().car().car())
+#define DEFINE_PROC_ARGS(exp)	((exp).cdr().car().cdr())
+#define DEFINE_PROC_BODY(exp)	((exp).cdr().cdr())
+// ASSIGNMENT
+#define ASSIGNMENT_VAR(exp)		((exp).cdr().car())
+#define ASSIGNMENT_VAL(exp)		((exp).cdr().cdr().car())
+// SEQUENCE
+#define SEQUENCE(exp)			((exp).cdr())
+// LAMBDA
+#define LAMBDA_ARGS(exp)		((exp).cdr().car())
+#define LAMBDA_BODY(exp)		((exp).cdr().cdr())
+// AND
+#define AND_ARGS(exp)			((exp).cdr())
+// OR
+#define OR_ARGS(exp)			((exp).cdr())
+// IF
+#define IF_PRED(exp)			((exp).cdr().car())
+#define IF_CON(exp)				((exp).cdr().cdr().car())
+#define HAS_IF_ALTER(exp)		(!(exp).cdr().cdr().cdr().isNull())
+#define IF_ALTER(exp)			((exp).cdr().cdr().cdr().car())
+// COND
+#define IS_ELSE(exp)			TAGGED_LIST(exp, Syntax::FORM_ELSE)
+#define COND_CLUASES(exp)		((exp).cdr())
+#define COND_PRED(exp)			((exp).car())
+#define COND_CONSEQUENCE(exp)	((exp).cdr())
+// LET
+#define LET_BINDINGS(exp)		((exp).cdr().car())
+#define BINDING_VAR(exp)		((exp).car())
+#define BINDING_VAL(exp)		((exp).cdr().car())
+#define LET_BODY(exp)			((exp).cdr().cdr())
+// APPLICATION
+#define APPLICATION_NAME(exp)	((exp).car())
+#define APPLICATION_ARGS(exp)	((exp).cdr())
+
+namespace Syntax {
+
+	// Form of expression
+	enum Form {
+		FORM_NONE,
+		FORM_APPLICATION,
+		FORM_QUOTE,
+		FORM_DEFINE,
+		FORM_ASSIGNMENT,
+		FORM_SEQ,
+		FORM_LAMBDA,
+		FORM_AND,
+		FORM_OR,
+		FORM_IF,
+		FORM_COND,
+		FORM_ELSE,
+		FORM_LET
+	};
+
+	// Get form of expression
+	Form formOf(const Variable& expr);
+
+	// Resolver from variables to frame slots
+	class Resolver
+	{
+		// Type alias
+		using Layout = Environment::Layout;
+
+		// Layouts of frames, innermost at back
+		std::vector<std::shared_ptr<Layout>> scopes;
+
+		// Enter frame, internal definitions of body get slots after bound variables
+		std::shared_ptr<const Layout> enter(std::shared_ptr<Layout> layout, const Variable& body);
+
+	public:
+
+		// Constructor for top-environment
+		Resolver() {}
+
+		// Constructor for frames of environment
+		explicit Resolver(const Environment& env);
+
+		// Enter frame of procedure
+		std::shared_ptr<const Layout> enterLambda(const Variable& args, const Variable& body);
+
+		// Enter frame of let
+		std::shared_ptr<const Layout> enterLet(const Variable& bindings, const Variable& body);
+
+		// Leave frame
+		void leave();
+
+		// Resolve variable into depth and slot, false if global
+		bool resolve(const Variable& var, int& depth, int& slot) const;
+	};
+
+}
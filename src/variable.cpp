@@ -3,6 +3,7 @@
 //
 // Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
 //
+#include <limits>
 #include <boost/multiprecision/cpp_int.hpp>
 #include "variable.hpp"
 
@@ -19,14 +20,84 @@ const Variable VAR_FALSE	= Variable();
 using namespace std;
 using namespace boost::multiprecision;
 
-// Parser
-extern int yyparse(std::istream* in, std::ostream* out = 0);
-extern Variable yypval;
+// Open addressing table of symbols, symbols aren't referenced by table unless pinned
+class Variable::SymbolTable
+{
+	std::vector<Symbol*> slots;		// Symbols, null if empty
+	size_t count = 0;				// Count of symbols
+	std::vector<int> freeIds;		// IDs of removed symbols
+	int nextId = 0;					// Next ID never assigned
+
+	// Grow table and insert symbols again
+	void grow()
+	{
+		std::vector<Symbol*> old(slots.size() ? slots.size() * 2 : 64, nullptr);
+		old.swap(slots);
+		for (Symbol* symbol : old)
+			if (symbol) {
+				size_t i = symbol->hash & (slots.size() - 1);
+				while (slots[i])
+					i = (i + 1) & (slots.size() - 1);
+				slots[i] = symbol;
+			}
+	}
+
+public:
+
+	// Find symbol by name or create it without reference, names are compared in a single probe
+	// Name is a view of chars, which is copied only when symbol is created
+	Symbol* intern(const char* name, size_t length)
+	{
+		if ((count + 1) * 4 > slots.size() * 3)
+			grow();
+		// FNV-1a hash, so that views are hashed without building strings
+		size_t hash = 14695981039346656037ULL;
+		for (size_t k = 0; k < length; k++)
+			hash = (hash ^ static_cast<unsigned char>(name[k])) * 1099511628211ULL;
+		size_t i = hash & (slots.size() - 1);
+		for (; slots[i]; i = (i + 1) & (slots.size() - 1))
+			if (slots[i]->hash == hash && slots[i]->name.compare(0, string::npos, name, length) == 0)
+				return slots[i];
+		// Symbol ID is dense, IDs of removed symbols are reused
+		int id = nextId;
+		if (freeIds.empty()) {
+			nextId++;
+		} else {
+			id = freeIds.back();
+			freeIds.pop_back();
+		}
+		Symbol* symbol = new Symbol(string(name, length), id, hash);
+		symbol->refCount = 0;
+		slots[i] = symbol;
+		count++;
+		return symbol;
+	}
+
+	// Remove symbol without reference, following symbols are shifted back to keep probes unbroken
+	void remove(const Symbol* symbol)
+	{
+		size_t mask = slots.size() - 1;
+		size_t i = symbol->hash & mask;
+		while (slots[i] != symbol)
+			i = (i + 1) & mask;
+		for (size_t j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+			size_t home = slots[j]->hash & mask;
+			// Move symbol unless its home lies cyclically in (i, j]
+			if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+				slots[i] = slots[j];
+				i = j;
+			}
+		}
+		slots[i] = nullptr;
+		count--;
+		freeIds.push_back(symbol->id);
+	}
+};
 
 // Constructors
 
 // Constructor for special
-Variable::Variable(): type(TYPE_SPEC), refCount(new int(1)) 
+Variable::Variable(): type(TYPE_SPEC), objPtr(new Object(TYPE_SPEC)) 
 {
 	#ifdef STATS
 	Statistic::createVariable();
@@ -34,17 +105,18 @@ Variable::Variable(): type(TYPE_SPEC), refCount(new int(1))
 }
 
 // Constructor for rational
-Variable::Variable(const cpp_rational& rational): 
-	type(TYPE_RATIONAL), refCount(new int(1)), rationalPtr(new cpp_rational(rational))
+Variable::Variable(const cpp_rational& rational): type(TYPE_RATIONAL)
 {
-	#ifdef STATS
-	Statistic::createVariable();
-	#endif
+	initRational(rational);
 }
 
+// Constructor for fixnum
+Variable::Variable(long value):
+	type(TYPE_RATIONAL), immediate(true), fixnum(value) {}
+
 // Constructor for double
 Variable::Variable(double value):
-	type(TYPE_FLOAT), refCount(new int(1)), doublePtr(new double(value))
+	type(TYPE_FLOAT), doublePtr(new Box<double>(TYPE_FLOAT, value))
 {
 	#ifdef STATS
 	Statistic::createVariable();
@@ -52,20 +124,26 @@ Variable::Variable(double value):
 }
 
 // Constructor for rational, double, string and symbol
-Variable::Variable(const string &str, Type type): type(type), refCount(new int(1))
+Variable::Variable(const string &str, Type type): type(type)
 {
 	switch (type) {
 		// Convert string to rational
 		case TYPE_RATIONAL:
-			rationalPtr = new cpp_rational(str);
-			break;
+			initRational(cpp_rational(str));
+			return;
 		// Convert string to double
 		case TYPE_FLOAT:
-			doublePtr = new double(stod(str));
+			doublePtr = new Box<double>(type, stod(str));
 			break;
-		case TYPE_SYMBOL:
+		// Symbols are always interned, handle is held until referenced so that a new symbol isn't freed
+		case TYPE_SYMBOL: {
+			Variable symbol = createSymbol(str);
+			symbolPtr = symbol.symbolPtr;
+			symbolPtr->refCount++;
+			return;
+		}
 		case TYPE_STRING:
-			stringPtr = new string(str);
+			stringPtr = new Box<string>(type, str);
 			break;
 		default:
 			throw Exception("intern error: variable construction error");
@@ -76,8 +154,8 @@ Variable::Variable(const string &str, Type type): type(type), refCount(new int(1
 }
 
 // Constructor for primitive procedure
-Variable::Variable(const string& name, const function& func):
-	type(TYPE_PRIM), refCount(new int(1)), primPtr(new Primitive(name, func))
+Variable::Variable(const string& name, int minArgs, int maxArgs, function func):
+	type(TYPE_PRIM), primPtr(new Primitive(name, minArgs, maxArgs, func))
 {
 	#ifdef STATS
 	Statistic::createVariable();
@@ -85,20 +163,31 @@ Variable::Variable(const string& name, const function& func):
 }
 
 // Constructor for compound procedure
-Variable::Variable(const string& name, const Variable& args, const Variable& body, const Environment& env):
-	type(TYPE_COMP), refCount(new int(1)), compPtr(new Compound(name, args, body, env))
+Variable::Variable(const string& name, const Variable& args, const Variable& body, const Environment& env,
+	std::shared_ptr<const Evaluator::Body> code):
+	type(TYPE_COMP), compPtr(new Compound(name, args, body, env, std::move(code)))
 {
-	GarbageCollector::trace(*this);
+	freeQueued();
+	GarbageCollector::trace(*this, sizeof(Compound));
 	#ifdef STATS
 	Statistic::createVariable();
 	#endif
 }
 
 // Constructor for pairs
-Variable::Variable(const Variable& lhs, const Variable& rhs): 
-	type(TYPE_PAIR), refCount(new int(1)), pairPtr(new pair(lhs, rhs))
+Variable::Variable(Variable lhs, Variable rhs): 
+	type(TYPE_PAIR), pairPtr(new Pair(std::move(lhs), std::move(rhs)))
+{
+	freeQueued();
+	GarbageCollector::trace(*this, sizeof(Pair));
+	#ifdef STATS
+	Statistic::createVariable();
+	#endif
+}
+
+// Constructor for allocated object
+Variable::Variable(Object* objPtr): type(objPtr->type), objPtr(objPtr)
 {
-	GarbageCollector::trace(*this);
 	#ifdef STATS
 	Statistic::createVariable();
 	#endif
@@ -106,23 +195,41 @@ Variable::Variable(const Variable& lhs, const Variable& rhs):
 
 // Copy constructor
 Variable::Variable(const Variable& var): 
-	type(var.type), refCount(var.refCount), voidPtr(var.voidPtr), GarbageObject(var)
+	type(var.type), immediate(var.immediate), objPtr(var.objPtr)
 {
+	// Fixnum isn't reference counted
+	if (immediate)
+		return;
 	#ifdef STATS
 	Statistic::copyVariable();
 	#endif
 	// Increase reference count
-	(*refCount)++;
+	objPtr->refCount++;
+}
+
+// Move constructor
+Variable::Variable(Variable&& var) noexcept:
+	type(var.type), immediate(var.immediate), objPtr(var.objPtr)
+{
+	#ifdef STATS
+	Statistic::moveVariable();
+	#endif
+	// Leave fixnum zero behind, so that nothing is released and no type check sees an object
+	var.type = TYPE_RATIONAL;
+	var.immediate = true;
+	var.fixnum = 0;
 }
 
 // Destructor
 Variable::~Variable() {
+	// Fixnum isn't reference counted
+	if (immediate)
+		return;
 	// Decrease reference count
-	(*refCount)--;
-	if (*refCount > 0)
+	objPtr->refCount--;
+	if (objPtr->refCount > 0)
 		return;
 	// Free memory
-	delete refCount;
 	switch (type) {
 		case TYPE_RATIONAL:
 			delete rationalPtr;
@@ -131,26 +238,60 @@ Variable::~Variable() {
 			delete doublePtr;
 			break;
 		case TYPE_STRING:
-		case TYPE_SYMBOL:
 			delete stringPtr;
 			break;
+		case TYPE_SYMBOL:
+			getSymbols().remove(symbolPtr);
+			delete symbolPtr;
+			break;
 		case TYPE_PAIR:
-			delete pairPtr;
+		case TYPE_COMP:
+			release(objPtr);
 			break;
 		case TYPE_PRIM:
 			delete primPtr;
 			break;
-		case TYPE_COMP:
-			delete compPtr;		
-			break;
 		default:
-			;
+			delete objPtr;
 	}
 	#ifdef STATS
 	Statistic::destroyVariable();
 	#endif
 }
 
+// Queue of objects to be freed, never destroyed so that objects freed on exit can be queued
+std::vector<Variable::Object*>& Variable::getFreeQueue()
+{
+	static std::vector<Object*>* queue = new std::vector<Object*>();
+	return *queue;
+}
+
+// Queue object without reference, and free a batch
+void Variable::release(Object* objPtr)
+{
+	getFreeQueue().push_back(objPtr);
+	freeQueued();
+}
+
+// Free a batch of queued objects, objects released meanwhile are queued rather than freed recursively
+void Variable::freeQueued()
+{
+	static bool freeing = false;
+	std::vector<Object*>& queue = getFreeQueue();
+	if (freeing || queue.empty())
+		return;
+	freeing = true;
+	for (int i = 0; i < FREE_BATCH && !queue.empty(); i++) {
+		Object* objPtr = queue.back();
+		queue.pop_back();
+		if (objPtr->type == TYPE_PAIR)
+			delete static_cast<Pair*>(objPtr);
+		else
+			delete static_cast<Compound*>(objPtr);
+	}
+	freeing = false;
+}
+
 // Assignment
 Variable& Variable::operator=(Variable var)
 {
@@ -161,10 +302,9 @@ Variable& Variable::operator=(Variable var)
 // Swap two variables
 void swap(Variable& lhs, Variable& rhs)
 {
-	std::swap(static_cast<GarbageObject&>(lhs), static_cast<GarbageObject&>(rhs));
 	std::swap(lhs.type, rhs.type);
-	std::swap(lhs.voidPtr, rhs.voidPtr);
-	std::swap(lhs.refCount, rhs.refCount);
+	std::swap(lhs.immediate, rhs.immediate);
+	std::swap(lhs.objPtr, rhs.objPtr);
 }
 
 // Standard I/0
@@ -198,16 +338,19 @@ ostream& operator<<(ostream& out, const Variable& var)
 				out << "#f";
 			break;
 		case Variable::TYPE_RATIONAL:
-			out << *(var.rationalPtr);
+			if (var.isFixnum())
+				out << var.fixnum;
+			else
+				out << var.rationalPtr->value;
 			break;
 		case Variable::TYPE_FLOAT:
-			out << *(var.doublePtr);
+			out << var.doublePtr->value;
 			break;
 		case Variable::TYPE_STRING:
-			out << *(var.stringPtr);
+			out << var.stringPtr->value;
 			break;
 		case Variable::TYPE_SYMBOL:
-			out << *(var.stringPtr);
+			out << var.symbolPtr->name;
 			break;
 		case Variable::TYPE_PRIM:
 		case Variable::TYPE_COMP:
@@ -219,13 +362,6 @@ ostream& operator<<(ostream& out, const Variable& var)
 	return out;
 }
 
-istream& operator>>(istream& in, Variable& var)
-{
-	yyparse(&in);
-	var = yypval;
-	return in;
-}
-
 // Require type
 
 void Variable::requireType(const string &caller, Type type) const
@@ -287,21 +423,23 @@ string Variable::toString() const
 double Variable::toDouble() const
 {
 	requireType("convert to double", TYPE_NUMBER);
+	if (isFixnum())
+		return static_cast<double>(fixnum);
 	if (type == TYPE_RATIONAL)
-		return static_cast<double>(*rationalPtr);
-	return *doublePtr;
+		return static_cast<double>(rationalPtr->value);
+	return doublePtr->value;
 }
 
 // Check operations
 
 bool Variable::isNull() const
 {
-	return refCount == VAR_NULL.refCount;
+	return type == TYPE_SPEC && objPtr == VAR_NULL.objPtr;
 }
 
 bool Variable::isVoid() const
 {
-	return refCount == VAR_VOID.refCount;
+	return type == TYPE_SPEC && objPtr == VAR_VOID.objPtr;
 }
 
 bool Variable::isPair() const
@@ -317,7 +455,7 @@ bool Variable::isNumber() const
 bool Variable::isInteger() const
 {
 	return type == TYPE_RATIONAL &&
-		denominator(*rationalPtr) == 1;
+		(isFixnum() || denominator(rationalPtr->value) == 1);
 }
 
 bool Variable::isSymbol() const
@@ -345,6 +483,43 @@ bool Variable::isProcedure() const
 	return type & (TYPE_COMP | TYPE_PRIM);
 }
 
+// Optimization: fixnum
+
+bool Variable::isFixnum() const
+{
+	return immediate;
+}
+
+// Store rational as fixnum if it's an integer fitting in machine word
+void Variable::initRational(const cpp_rational& rational)
+{
+	const cpp_int& num = numerator(rational);
+	if (denominator(rational) == 1
+		&& num >= numeric_limits<long>::min()
+		&& num <= numeric_limits<long>::max()) {
+		immediate = true;
+		fixnum = num.convert_to<long>();
+		return;
+	}
+	rationalPtr = new Box<cpp_rational>(TYPE_RATIONAL, rational);
+	#ifdef STATS
+	Statistic::createVariable();
+	#endif
+}
+
+// Promote fixnums to rationals and apply operation
+template <typename Result, typename Operation>
+Result Variable::promote(const Variable& lhs, const Variable& rhs, Operation op)
+{
+	if (lhs.isFixnum() && rhs.isFixnum())
+		return op(cpp_rational(lhs.fixnum), cpp_rational(rhs.fixnum));
+	if (lhs.isFixnum())
+		return op(cpp_rational(lhs.fixnum), rhs.rationalPtr->value);
+	if (rhs.isFixnum())
+		return op(lhs.rationalPtr->value, cpp_rational(rhs.fixnum));
+	return op(lhs.rationalPtr->value, rhs.rationalPtr->value);
+}
+
 // Arithmetic operations
 
 Variable operator+(const Variable& lhs, const Variable& rhs)
@@ -353,9 +528,14 @@ Variable operator+(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("+", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return Variable(*lhs.doublePtr + *rhs.doublePtr);
-		case Variable::TYPE_RATIONAL:
-			return Variable(*lhs.rationalPtr + *rhs.rationalPtr);
+			return Variable(lhs.doublePtr->value + rhs.doublePtr->value);
+		case Variable::TYPE_RATIONAL: {
+			long result;
+			if (lhs.isFixnum() && rhs.isFixnum() 
+				&& !__builtin_add_overflow(lhs.fixnum, rhs.fixnum, &result))
+				return Variable(result);
+			return Variable::promote<Variable>(lhs, rhs, plus<cpp_rational>());
+		}
 		default:
 			return Variable(lhs.toDouble() + rhs.toDouble());
 	}
@@ -367,9 +547,14 @@ Variable operator-(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("-", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return Variable(*lhs.doublePtr - *rhs.doublePtr);
-		case Variable::TYPE_RATIONAL:
-			return Variable(*lhs.rationalPtr - *rhs.rationalPtr);
+			return Variable(lhs.doublePtr->value - rhs.doublePtr->value);
+		case Variable::TYPE_RATIONAL: {
+			long result;
+			if (lhs.isFixnum() && rhs.isFixnum() 
+				&& !__builtin_sub_overflow(lhs.fixnum, rhs.fixnum, &result))
+				return Variable(result);
+			return Variable::promote<Variable>(lhs, rhs, minus<cpp_rational>());
+		}
 		default:
 			return Variable(lhs.toDouble() - rhs.toDouble());
 	}
@@ -381,9 +566,14 @@ Variable operator*(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("*", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return Variable(*lhs.doublePtr * *rhs.doublePtr);
-		case Variable::TYPE_RATIONAL:
-			return Variable(*lhs.rationalPtr * *rhs.rationalPtr);
+			return Variable(lhs.doublePtr->value * rhs.doublePtr->value);
+		case Variable::TYPE_RATIONAL: {
+			long result;
+			if (lhs.isFixnum() && rhs.isFixnum() 
+				&& !__builtin_mul_overflow(lhs.fixnum, rhs.fixnum, &result))
+				return Variable(result);
+			return Variable::promote<Variable>(lhs, rhs, multiplies<cpp_rational>());
+		}
 		default:
 			return Variable(lhs.toDouble() * rhs.toDouble());
 	}
@@ -395,13 +585,16 @@ Variable operator/(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("/", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			if (*rhs.doublePtr == 0)
+			if (rhs.doublePtr->value == 0)
 				throw Exception("/: division by zero");
-			return Variable(*lhs.doublePtr / *rhs.doublePtr);
+			return Variable(lhs.doublePtr->value / rhs.doublePtr->value);
 		case Variable::TYPE_RATIONAL:
-			if (*rhs.rationalPtr == 0)
+			if (rhs.isFixnum() && rhs.fixnum == 0)
 				throw Exception("/: division by zero");
-			return Variable(*lhs.rationalPtr / *rhs.rationalPtr);
+			if (lhs.isFixnum() && rhs.isFixnum() && rhs.fixnum != -1 
+				&& lhs.fixnum % rhs.fixnum == 0)
+				return Variable(lhs.fixnum / rhs.fixnum);
+			return Variable::promote<Variable>(lhs, rhs, divides<cpp_rational>());
 		default:
 			double a = lhs.toDouble();
 			double b = rhs.toDouble();
@@ -415,53 +608,71 @@ Variable operator-(const Variable& var)
 {
 	var.requireType("-", Variable::TYPE_NUMBER);
 	if (var.type == Variable::TYPE_FLOAT)
-		return Variable(- *var.doublePtr);
-	return Variable(- *var.rationalPtr);
+		return Variable(- var.doublePtr->value);
+	if (var.isFixnum() && var.fixnum != numeric_limits<long>::min())
+		return Variable(- var.fixnum);
+	if (var.isFixnum())
+		return Variable(- cpp_rational(var.fixnum));
+	return Variable(- var.rationalPtr->value);
 }
 
 Variable remainder(const Variable& lhs, const Variable& rhs)
 {
 	lhs.requireType("remainder", Variable::TYPE_INTEGER);
 	rhs.requireType("remainder", Variable::TYPE_INTEGER);
-	const cpp_int& a = numerator(*lhs.rationalPtr);
-	const cpp_int& b = numerator(*rhs.rationalPtr);
-	return Variable(cpp_rational(a%b));
+	if (rhs.isFixnum() && rhs.fixnum == 0)
+		throw Exception("remainder: division by zero");
+	if (lhs.isFixnum() && rhs.isFixnum())
+		return Variable(rhs.fixnum == -1 ? 0 : lhs.fixnum % rhs.fixnum);
+	return Variable::promote<Variable>(lhs, rhs, [](const cpp_rational& a, const cpp_rational& b) {
+		return cpp_rational(numerator(a) % numerator(b));
+	});
 }
 
 Variable quotient(const Variable& lhs, const Variable& rhs)
 {
 	lhs.requireType("quotient", Variable::TYPE_INTEGER);
 	rhs.requireType("quotient", Variable::TYPE_INTEGER);
-	const cpp_int& a = numerator(*lhs.rationalPtr);
-	const cpp_int& b = numerator(*rhs.rationalPtr);
-	return Variable(cpp_rational(a/b));
+	if (rhs.isFixnum() && rhs.fixnum == 0)
+		throw Exception("quotient: division by zero");
+	if (lhs.isFixnum() && rhs.isFixnum() && rhs.fixnum != -1)
+		return Variable(lhs.fixnum / rhs.fixnum);
+	return Variable::promote<Variable>(lhs, rhs, [](const cpp_rational& a, const cpp_rational& b) {
+		return cpp_rational(numerator(a) / numerator(b));
+	});
 }
 
 Variable gcd(const Variable& lhs, const Variable& rhs)
 {
 	lhs.requireType("gcd", Variable::TYPE_INTEGER);
 	rhs.requireType("gcd", Variable::TYPE_INTEGER);
-	cpp_int a = numerator(*lhs.rationalPtr);
-	cpp_int b = numerator(*rhs.rationalPtr);
-	while (b) {
-		cpp_int temp = a;
-		a = b;
-		b = temp % b;
-	}
-	return Variable(cpp_rational(a));
+	return Variable::promote<Variable>(lhs, rhs, [](const cpp_rational& lhs, const cpp_rational& rhs) {
+		cpp_int a = numerator(lhs);
+		cpp_int b = numerator(rhs);
+		while (b) {
+			cpp_int temp = a;
+			a = b;
+			b = temp % b;
+		}
+		return cpp_rational(a);
+	});
 }
 
 bool Variable::isEven() const
 {
 	requireType("remainder", Variable::TYPE_INTEGER);
-	const cpp_int& a = numerator(*rationalPtr);
+	if (isFixnum())
+		return fixnum % 2 == 0;
+	const cpp_int& a = numerator(rationalPtr->value);
 	return a % 2 == 0;
 }
 
 bool Variable::isOdd() const
 {
 	requireType("remainder", Variable::TYPE_INTEGER);
-	const cpp_int& a = numerator(*rationalPtr);
+	if (isFixnum())
+		return fixnum % 2 == 1;
+	const cpp_int& a = numerator(rationalPtr->value);
 	return a % 2 == 1;
 }
 
@@ -473,9 +684,11 @@ bool operator<(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("<", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return *lhs.doublePtr < *rhs.doublePtr;
+			return lhs.doublePtr->value < rhs.doublePtr->value;
 		case Variable::TYPE_RATIONAL:
-			return *lhs.rationalPtr < *rhs.rationalPtr;
+			if (lhs.isFixnum() && rhs.isFixnum())
+				return lhs.fixnum < rhs.fixnum;
+			return Variable::promote<bool>(lhs, rhs, less<cpp_rational>());
 		default:
 			return lhs.toDouble() < rhs.toDouble();
 	}
@@ -487,9 +700,11 @@ bool operator>(const Variable& lhs, const Variable& rhs)
 	rhs.requireType(">", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return *lhs.doublePtr > *rhs.doublePtr;
+			return lhs.doublePtr->value > rhs.doublePtr->value;
 		case Variable::TYPE_RATIONAL:
-			return *lhs.rationalPtr > *rhs.rationalPtr;
+			if (lhs.isFixnum() && rhs.isFixnum())
+				return lhs.fixnum > rhs.fixnum;
+			return Variable::promote<bool>(lhs, rhs, greater<cpp_rational>());
 		default:
 			return lhs.toDouble() > rhs.toDouble();
 	}
@@ -501,9 +716,11 @@ bool operator<=(const Variable& lhs, const Variable& rhs)
 	rhs.requireType("<=", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return *lhs.doublePtr <= *rhs.doublePtr;
+			return lhs.doublePtr->value <= rhs.doublePtr->value;
 		case Variable::TYPE_RATIONAL:
-			return *lhs.rationalPtr <= *rhs.rationalPtr;
+			if (lhs.isFixnum() && rhs.isFixnum())
+				return lhs.fixnum <= rhs.fixnum;
+			return Variable::promote<bool>(lhs, rhs, less_equal<cpp_rational>());
 		default:
 			return lhs.toDouble() <= rhs.toDouble();
 	}
@@ -515,9 +732,11 @@ bool operator>=(const Variable& lhs, const Variable& rhs)
 	rhs.requireType(">=", Variable::TYPE_NUMBER);
 	switch (lhs.type | rhs.type) {
 		case Variable::TYPE_FLOAT:
-			return *lhs.doublePtr >= *rhs.doublePtr;
+			return lhs.doublePtr->value >= rhs.doublePtr->value;
 		case Variable::TYPE_RATIONAL:
-			return *lhs.rationalPtr >= *rhs.rationalPtr;
+			if (lhs.isFixnum() && rhs.isFixnum())
+				return lhs.fixnum >= rhs.fixnum;
+			return Variable::promote<bool>(lhs, rhs, greater_equal<cpp_rational>());
 		default:
 			return lhs.toDouble() >= rhs.toDouble();
 	}
@@ -526,19 +745,20 @@ bool operator>=(const Variable& lhs, const Variable& rhs)
 bool operator==(const Variable &lhs, const Variable &rhs)
 {
 	// Self compare
-	if (lhs.refCount == rhs.refCount)
+	if (!lhs.immediate && !rhs.immediate && lhs.objPtr == rhs.objPtr)
 		return true;
 	// Different type
 	if (lhs.type != rhs.type)
 		return false;
 	switch (lhs.type) {
 		case Variable::TYPE_FLOAT:
-			return *lhs.doublePtr == *rhs.doublePtr;
+			return lhs.doublePtr->value == rhs.doublePtr->value;
 		case Variable::TYPE_RATIONAL:
-			return *lhs.rationalPtr == *rhs.rationalPtr;
+			if (lhs.isFixnum() && rhs.isFixnum())
+				return lhs.fixnum == rhs.fixnum;
+			return Variable::promote<bool>(lhs, rhs, equal_to<cpp_rational>());
 		case Variable::TYPE_STRING:
-		case Variable::TYPE_SYMBOL:
-			return *lhs.stringPtr == *rhs.stringPtr;
+			return lhs.stringPtr->value == rhs.stringPtr->value;
 		case Variable::TYPE_PAIR:
 			return lhs.car() == rhs.car()
 					&& lhs.cdr() == rhs.cdr();
@@ -552,6 +772,25 @@ bool operator!=(const Variable& lhs, const Variable& rhs)
 	return !(lhs == rhs);
 }
 
+// Symbol operations
+
+int Variable::getSymbolId() const
+{
+	requireType("get symbol id", TYPE_SYMBOL);
+	// ID is used by bindings once got, so symbol is kept by table and ID is never reused
+	if (!symbolPtr->pinned) {
+		symbolPtr->pinned = true;
+		symbolPtr->refCount++;
+	}
+	return symbolPtr->id;
+}
+
+int Variable::peekSymbolId() const
+{
+	requireType("peek symbol id", TYPE_SYMBOL);
+	return symbolPtr->id;
+}
+
 // Pair operations
 
 Variable& Variable::car() const
@@ -566,26 +805,38 @@ Variable& Variable::cdr() const
 	return pairPtr->second;
 }
 
-Variable Variable::setCar(const Variable& var) const
+Variable Variable::setCar(Variable var) const
 {
 	requireType("set-car!", Variable::TYPE_PAIR);
-	pairPtr->first = var;
+	GarbageCollector::writeBarrier(pairPtr->first);
+	if (objPtr->gcTag == GarbageCollector::IMMORTAL) {
+		objPtr->gcTag = GarbageCollector::MUTATED;
+		GarbageCollector::rememberCode(*this);
+	}
+	pairPtr->first = std::move(var);
 	return VAR_VOID;
 }
 
-Variable Variable::setCdr(const Variable& var) const
+Variable Variable::setCdr(Variable var) const
 {
 	requireType("set-cdr!", Variable::TYPE_PAIR);
-	pairPtr->second = var;
+	GarbageCollector::writeBarrier(pairPtr->second);
+	if (objPtr->gcTag == GarbageCollector::IMMORTAL) {
+		objPtr->gcTag = GarbageCollector::MUTATED;
+		GarbageCollector::rememberCode(*this);
+	}
+	pairPtr->second = std::move(var);
 	return VAR_VOID;
 }
 
 // Procedure operations
 
-Variable Variable::operator()(const Variable& arg, Environment &env) const
+Variable Variable::operator()(int argc, const Variable* argv, Environment &env) const
 {
 	requireType("apply primitive procedure", TYPE_PRIM);
-	return primPtr->func(arg, env);
+	if (argc < primPtr->minArgs || (primPtr->maxArgs != VARIADIC && argc > primPtr->maxArgs))
+		throw Exception(primPtr->name + ": wrong number of arguments");
+	return primPtr->func(argc, argv, env);
 }
 
 Variable& Variable::getProcedureArgs() const
@@ -608,21 +859,37 @@ string Variable::getProcedureName() const
 	return compPtr->name;
 }
 
-Environment Variable::getProcedureEnv() const
+const Environment& Variable::getProcedureEnv() const
 {
 	requireType("get procedure env", TYPE_COMP);
 	return compPtr->env;
 }
 
-// Optimization: constant pool
+const Evaluator::Body& Variable::getProcedureCode() const
+{
+	requireType("get procedure code", TYPE_COMP);
+	return *compPtr->code;
+}
+
+// Optimization: weak symbol table
 
-std::unordered_map<std::string, Variable> Variable::pool;
+// Table is never destroyed, so that symbols freed on exit can be removed
+Variable::SymbolTable& Variable::getSymbols()
+{
+	static SymbolTable* symbols = new SymbolTable();
+	return *symbols;
+}
 
 Variable Variable::createSymbol(const std::string& str)
 {
-	if (pool.find(str) == pool.end())
-		pool[str] = Variable(str, Variable::TYPE_SYMBOL);
-	return pool[str];
+	return createSymbol(str.data(), str.size());
+}
+
+Variable Variable::createSymbol(const char* name, size_t length)
+{
+	Symbol* symbolPtr = getSymbols().intern(name, length);
+	symbolPtr->refCount++;
+	return Variable(symbolPtr);
 }
 
 // Optimization: garbage collection
@@ -643,26 +910,122 @@ void Variable::finalize() const
 	};
 }
 
-void Variable::scan(int tag) const
+// Tag is read and written atomically, so that values can be marked in parallel
+// Immortal code has negative tag, which is always considered tagged
+bool Variable::isTagged(int tag) const
+{
+	if (immediate)
+		return true;
+	int gcTag = __atomic_load_n(&objPtr->gcTag, __ATOMIC_RELAXED);
+	return gcTag == tag || gcTag < 0;
+}
+
+// Only pairs and closures are tagged, other values reference nothing to be scanned
+bool Variable::claim(int tag) const
+{
+	if ((type != TYPE_PAIR && type != TYPE_COMP) || isTagged(tag))
+		return false;
+	return __atomic_exchange_n(&objPtr->gcTag, tag, __ATOMIC_RELAXED) != tag;
+}
+
+const Variable* Variable::scan(int tag, GarbageCollector::MarkStack& stack) const
 {
 	switch (type) {
 		case TYPE_PAIR:
-			*gcTag = tag;
-			if (*pairPtr->first.gcTag != tag)
-				pairPtr->first.scan(tag);
-			if (*pairPtr->second.gcTag != tag)
-				pairPtr->second.scan(tag);
+			// Optimization: car is pushed, cdr is returned to be scanned in loop
+			__atomic_store_n(&objPtr->gcTag, tag, __ATOMIC_RELAXED);
+			if (!pairPtr->first.isTagged(tag))
+				stack.push_back(&pairPtr->first);
+			return &pairPtr->second;
+		case TYPE_COMP:
+			__atomic_store_n(&objPtr->gcTag, tag, __ATOMIC_RELAXED);
+			if (!compPtr->args.isTagged(tag))
+				stack.push_back(&compPtr->args);
+			if (!compPtr->body.isTagged(tag))
+				stack.push_back(&compPtr->body);
+			if (!compPtr->env.isTagged(tag))
+				compPtr->env.scan(tag, stack);
+			return nullptr;
+		default:
+			return nullptr;
+	}
+}
+
+bool Variable::isYoung() const
+{
+	return !immediate && objPtr->young;
+}
+
+const Variable* Variable::scanYoung(GarbageCollector::MarkStack& stack) const
+{
+	objPtr->young = false;
+	switch (type) {
+		case TYPE_PAIR:
+			// Optimization: car is pushed, cdr is returned to be scanned in loop
+			if (pairPtr->first.isYoung())
+				stack.push_back(&pairPtr->first);
+			return &pairPtr->second;
+		case TYPE_COMP:
+			if (compPtr->args.isYoung())
+				stack.push_back(&compPtr->args);
+			if (compPtr->body.isYoung())
+				stack.push_back(&compPtr->body);
+			compPtr->env.scanYoung(stack);
+			return nullptr;
+		default:
+			return nullptr;
+	}
+}
+
+void Variable::promote() const
+{
+	objPtr->young = false;
+}
+
+const Variable* Variable::immortalize(GarbageCollector::MarkStack& stack) const
+{
+	objPtr->gcTag = GarbageCollector::IMMORTAL;
+	objPtr->young = false;
+	if (type != TYPE_PAIR)
+		return nullptr;
+	// Optimization: car is pushed, cdr is returned to be scanned in loop
+	if (pairPtr->first.isYoung())
+		stack.push_back(&pairPtr->first);
+	return &pairPtr->second;
+}
+
+void Variable::countRefs(vector<Environment>& frames, bool young) const
+{
+	// Reference from list of collector isn't counted
+	objPtr->gcRefs = objPtr->refCount - 1;
+	if (type == TYPE_COMP)
+		compPtr->env.countRefs(frames, young);
+}
+
+void Variable::discountRefs(bool young) const
+{
+	switch (type) {
+		case TYPE_PAIR:
+			pairPtr->first.discount(young);
+			pairPtr->second.discount(young);
 			break;
 		case TYPE_COMP:
-			*gcTag = tag;
-			if (*compPtr->args.gcTag != tag)
-				compPtr->args.scan(tag);
-			if (*compPtr->body.gcTag != tag)
-				compPtr->body.scan(tag);
-			if (*compPtr->env.gcTag != tag)
-				compPtr->env.scan(tag);
+			compPtr->args.discount(young);
+			compPtr->body.discount(young);
+			compPtr->env.discount(young);
 			break;
 		default:
 			;
 	}
-}
\ No newline at end of file
+}
+
+void Variable::discount(bool young) const
+{
+	if (!immediate && (type == TYPE_PAIR || type == TYPE_COMP) && (!young || objPtr->young))
+		objPtr->gcRefs--;
+}
+
+bool Variable::isRoot() const
+{
+	return objPtr->gcRefs > 0;
+}
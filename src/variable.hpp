@@ -7,16 +7,24 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <sstream>
 #include <iostream>
-#include <functional>
-#include <unordered_map>
 #include <boost/multiprecision/cpp_int.hpp>
 #include "exception.hpp"
 #include "environment.hpp"
 #include "garbage.hpp"
+#include "pool.hpp"
 
-class Variable: public GarbageObject
+namespace Evaluator {
+	class Body;
+}
+
+namespace Fasl {
+	class Writer;
+}
+
+class Variable
 {
 public:
 
@@ -37,41 +45,59 @@ public:
 		// Sub type
 		TYPE_INTEGER	= 0x100
 	};
+
+	// Count of arguments for primitive procedure taking any count
+	static const int VARIADIC = -1;
 	
 private:
 
 	// Indent class
+	struct Object;
+	template <typename T> struct Box;
+	struct Pair;
+	struct Symbol;
 	struct Primitive;
 	struct Compound;
 	friend Environment;
+	friend Fasl::Writer;
 
 	// Type alias
 	using string = std::string;
 	using ostream = std::ostream;
 	using istream = std::istream;
 	using ostringstream = std::ostringstream;
-	using pair = std::pair<Variable, Variable>;
 	using cpp_rational = boost::multiprecision::cpp_rational;
-	using function = std::function<Variable(const Variable&, Environment&)>;
+	// Optimization: primitives take evaluated arguments in place, no list consed
+	using function = Variable (*)(int argc, const Variable* argv, Environment& env);
 
-	// Optimization: constant pool
-	static std::unordered_map<std::string, Variable> pool;
+	// Optimization: weak symbol table, constructed on first use
+	class SymbolTable;
+	static SymbolTable& getSymbols();
+
+	// Optimization: pairs and closures are freed from queue in batches instead of recursion,
+	// so that freeing long list uses bounded stack, queue is constructed on first use
+	static const int FREE_BATCH = 16;
+	static std::vector<Object*>& getFreeQueue();
+	static void release(Object* objPtr);
+	static void freeQueued();
 
 	// Type of variable
 	Type type;
 
-	// Reference count
-	int* refCount = nullptr;
+	// Optimization: fixnum isn't allocated
+	bool immediate = false;
 
 	// Value of variable
 	union {
-		cpp_rational*	rationalPtr;
-		double*		doublePtr;
-		string*		stringPtr;
-		pair*		pairPtr;
-		void*		voidPtr;
-		Primitive*	primPtr;
-		Compound*	compPtr;
+		long			fixnum;
+		Object*			objPtr;
+		Box<cpp_rational>*	rationalPtr;
+		Box<double>*		doublePtr;
+		Box<string>*		stringPtr;
+		Pair*			pairPtr;
+		Symbol*			symbolPtr;
+		Primitive*		primPtr;
+		Compound*		compPtr;
 	};
 
 public:
@@ -82,6 +108,9 @@ public:
 	// Constructor for rational
 	Variable(const cpp_rational& rational);
 
+	// Constructor for fixnum
+	Variable(long value);
+
 	// Constructor for double
 	Variable(double value);
 
@@ -89,38 +118,72 @@ public:
 	Variable(const string &str, Type type);
 
 	// Constructor for pairs
-	Variable(const Variable& lhs, const Variable& rhs);
+	Variable(Variable lhs, Variable rhs);
 
-	// Constructor for primitive procedure
-	Variable(const string& name, const function& func);
+	// Constructor for primitive procedure, maxArgs is VARIADIC for any count
+	Variable(const string& name, int minArgs, int maxArgs, function func);
 
 	// Constructor for compound procedure
-	Variable(const string& name, const Variable& args, const Variable& body, const Environment& env);
+	Variable(const string& name, const Variable& args, const Variable& body, const Environment& env,
+		std::shared_ptr<const Evaluator::Body> code);
+
+	// Constructor for allocated object
+	explicit Variable(Object* objPtr);
 
 	// Copy constructor
 	Variable(const Variable& var);
 
+	// Move constructor
+	Variable(Variable&& var) noexcept;
+
 	// Destructor
 	~Variable();
 
 	// Swap two variables
 	friend void swap(Variable& lhs, Variable& rhs);
 
-	// Assignment
+	// Copy and move assignment
 	Variable& operator=(Variable var);
 
 	// Optimization: constant pool
 	static Variable createSymbol(const std::string& str);
+	static Variable createSymbol(const char* name, size_t length);
 
 	// Finalize value
-	void finalize() const override;
+	void finalize() const;
+
+	// Scan and tag value in using, values referenced are pushed onto stack except cdr returned
+	const Variable* scan(int tag, GarbageCollector::MarkStack& stack) const;
+
+	// Check whether value has been tagged
+	bool isTagged(int tag) const;
 
-	// Scan and tag value in using
-	void scan(int tag) const override;
+	// Tag value atomically in parallel marking, return whether it's tagged by this call
+	bool claim(int tag) const;
+
+	// Check whether value is allocated since last collection
+	bool isYoung() const;
+
+	// Scan and promote young value in using, young values referenced are pushed onto stack except cdr returned
+	const Variable* scanYoung(GarbageCollector::MarkStack& stack) const;
+
+	// Move value into old generation
+	void promote() const;
+
+	// Tag young code as immortal, young values referenced are pushed onto stack except cdr returned
+	const Variable* immortalize(GarbageCollector::MarkStack& stack) const;
+
+	// Count references to collected values from outside, frames of closures are collected as well
+	void countRefs(std::vector<Environment>& frames, bool young) const;
+
+	// Discount references from value to collected values
+	void discountRefs(bool young) const;
+
+	// Check whether value is referenced from outside of collected values
+	bool isRoot() const;
 
 	// Standard I/O
 	friend ostream& operator<<(ostream& out, const Variable& var);
-	friend istream& operator>>(istream& in, Variable& var);
 
 	// Require type, throw exception if type is wrong
 	void requireType(const string &caller, Type type) const;
@@ -164,38 +227,104 @@ public:
 	friend bool operator==(const Variable& lhs, const Variable& rhs);
 	friend bool operator!=(const Variable& lhs, const Variable& rhs);
 
+	// Symbol operations
+	int getSymbolId() const;
+	int peekSymbolId() const;	// ID without pinning, reused once symbol is freed
+
 	// Pair operations
 	Variable& car() const;
 	Variable& cdr() const;
-	Variable setCar(const Variable& var) const;
-	Variable setCdr(const Variable& var) const;
+	Variable setCar(Variable var) const;
+	Variable setCdr(Variable var) const;
 
 	// Procedure operations
-	Variable operator()(const Variable& arg, Environment& env) const;
+	Variable operator()(int argc, const Variable* argv, Environment& env) const;
 	Variable& getProcedureArgs() const;
 	Variable& getProcedureBody() const;
 	string getProcedureName() const;
-	Environment getProcedureEnv() const;
+	const Environment& getProcedureEnv() const;
+	const Evaluator::Body& getProcedureCode() const;
+
+private:
+
+	// Optimization: fixnum
+	bool isFixnum() const;
+	void initRational(const cpp_rational& rational);
+	template <typename Result, typename Operation>
+	static Result promote(const Variable& lhs, const Variable& rhs, Operation op);
+
+	// Discount a reference to value if collected
+	void discount(bool young) const;
+};
+
+// Object header, allocated in one block with payload
+
+struct Variable::Object
+{
+	int refCount;	// Reference count
+	Type type;		// Type of payload
+	int gcTag;		// Epoch of GC marked
+	int gcRefs;		// References from outside of collected values
+	bool young;		// Allocated since last collection?
+	Object(Type type, bool young = false): refCount(1), type(type), gcTag(0), gcRefs(0), young(young) {}
+	// Optimization: objects are allocated from pools segregated by size, freed memory returns to pool
+	static void* operator new(size_t size) { return Pool::allocate(size); }
+	static void operator delete(void* ptr, size_t size) { Pool::free(ptr, size); }
+};
+
+// Boxed value
+
+template <typename T>
+struct Variable::Box: Object
+{
+	T value;		// Value
+	Box(Type type, const T& value): Object(type), value(value) {}
+};
+
+// Pair
+
+struct Variable::Pair: Object
+{
+	Variable first, second;	// Car and cdr
+	Pair(Variable&& first, Variable&& second): 
+		Object(TYPE_PAIR, true), first(std::move(first)), second(std::move(second)) {}
+};
+
+// Symbol
+
+struct Variable::Symbol: Object
+{
+	string name;	// Name of symbol
+	int id;			// Dense ID of symbol
+	size_t hash;	// Hash of name
+	bool pinned;	// Is ID used by bindings?
+	Symbol(const string& name, int id, size_t hash): 
+		Object(TYPE_SYMBOL), name(name), id(id), hash(hash), pinned(false) {}
 };
 
 // Primitive procedure
 
-struct Variable::Primitive
+struct Variable::Primitive: Object
 {
 	string name;	// Name of procedure
-	function func;	// Function object
-	Primitive(const string& name, const function& func): name(name), func(func) {}
+	int minArgs;	// Least count of arguments
+	int maxArgs;	// Most count of arguments, VARIADIC if unlimited
+	function func;	// Function
+	Primitive(const string& name, int minArgs, int maxArgs, function func): 
+		Object(TYPE_PRIM), name(name), minArgs(minArgs), maxArgs(maxArgs), func(func) {}
 };
 
 // Compound procedure
 
-struct Variable::Compound
+struct Variable::Compound: Object
 {
 	string name;		// Name of procedure
 	Variable args, body;// Argument and body
 	Environment env;	// Closure
-	Compound(const string& name, const Variable& args, const Variable& body, const Environment& env):
-		name(name), args(args), body(body), env(env) {}
+	std::shared_ptr<const Evaluator::Body> code;	// Analyzed body
+	Compound(const string& name, const Variable& args, const Variable& body, const Environment& env,
+		std::shared_ptr<const Evaluator::Body> code):
+		Object(TYPE_COMP, true), name(name), args(args), body(body), env(env), code(std::move(code)) {}
 };
 
 // Constant values
@@ -0,0 +1,480 @@
+//
+// Scheme Bytecode Virtual Machine
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#include <typeinfo>
+#include "vm.hpp"
+#include "syntax.hpp"
+#include "exception.hpp"
+
+#ifdef LOG
+#include "log.hpp"
+#endif
+
+using namespace std;
+using namespace VM;
+using namespace Syntax;
+
+namespace {
+
+	// Compiler for a function, resolver is shared by nested functions
+	class Compiler
+	{
+		Function& fn;
+		Resolver& resolver;
+
+		// Emit instruction
+		void emit(int op) { fn.code.push_back(op); }
+		void emit(int op, int a) { emit(op); emit(a); }
+		void emit(int op, int a, int b) { emit(op); emit(a); emit(b); }
+
+		// Emit jump and return position of target to patch
+		size_t emitJump(int op)
+		{
+			emit(op, 0);
+			return fn.code.size() - 1;
+		}
+
+		// Patch jump target to current position
+		void patch(size_t pos) { fn.code[pos] = fn.code.size(); }
+
+		// Add constant
+		int addConst(const Variable& var)
+		{
+			fn.consts.push_back(var);
+			return fn.consts.size() - 1;
+		}
+
+		// Add global, shared by references to the same variable
+		int addGlobal(const Variable& var)
+		{
+			for (size_t i = 0; i < fn.globals.size(); i++)
+				if (fn.globals[i].var.getSymbolId() == var.getSymbolId())
+					return i;
+			fn.globals.emplace_back(var);
+			return fn.globals.size() - 1;
+		}
+
+		// Return if in tail position
+		void ret(bool tail)
+		{
+			if (tail)
+				emit(OP_RETURN);
+		}
+
+		void compileRef(const Variable& var)
+		{
+			int depth, slot;
+			if (resolver.resolve(var, depth, slot))
+				emit(OP_LOCAL_REF, depth, slot);
+			else
+				emit(OP_GLOBAL_REF, addGlobal(var));
+		}
+
+		void compileSet(const Variable& var)
+		{
+			int depth, slot;
+			if (resolver.resolve(var, depth, slot))
+				emit(OP_LOCAL_SET, depth, slot);
+			else
+				emit(OP_GLOBAL_SET, addGlobal(var));
+		}
+
+		// Variables not in current frame are defined by name
+		void compileDefine(const Variable& var)
+		{
+			int depth, slot;
+			if (resolver.resolve(var, depth, slot) && depth == 0)
+				emit(OP_LOCAL_SET, depth, slot);
+			else
+				emit(OP_DEFINE, addConst(var));
+		}
+
+		void compileSeq(const Variable& exps, bool tail)
+		{
+			if (exps.isNull()) {
+				emit(OP_CONST, addConst(VAR_VOID));
+				ret(tail);
+				return;
+			}
+			for (const Variable* it = &exps; !it->isNull(); it = &it->cdr()) {
+				if (it->cdr().isNull()) {
+					compile(it->car(), tail);
+				} else {
+					compile(it->car(), false);
+					emit(OP_POP);
+				}
+			}
+		}
+
+		void compileLambda(const string& name, const Variable& args, const Variable& body)
+		{
+			auto lambda = make_shared<Function>();
+			lambda->name = name;
+			lambda->args = args;
+			lambda->body = body;
+			for (const Variable* it = &args; !it->isNull(); it = &it->cdr())
+				lambda->argc++;
+			lambda->layout = resolver.enterLambda(args, body);
+			Compiler(*lambda, resolver).compileSeq(body, true);
+			resolver.leave();
+			fn.functions.push_back(lambda);
+			emit(OP_CLOSURE, fn.functions.size() - 1);
+		}
+
+		void compileIf(const Variable& expr, bool tail)
+		{
+			compile(IF_PRED(expr), false);
+			size_t alter = emitJump(OP_JUMP_IF_FALSE);
+			compile(IF_CON(expr), tail);
+			size_t end = tail ? 0 : emitJump(OP_JUMP);
+			patch(alter);
+			if (HAS_IF_ALTER(expr)) {
+				compile(IF_ALTER(expr), tail);
+			} else {
+				emit(OP_CONST, addConst(VAR_VOID));
+				ret(tail);
+			}
+			if (!tail)
+				patch(end);
+		}
+
+		void compileCond(const Variable& expr, bool tail)
+		{
+			vector<size_t> ends;
+			bool hasElse = false;
+			for (const Variable* clauses = &COND_CLUASES(expr); !clauses->isNull() && !hasElse; clauses = &clauses->cdr()) {
+				const Variable& clause = clauses->car();
+				if (IS_ELSE(clause)) {
+					compileSeq(COND_CONSEQUENCE(clause), tail);
+					hasElse = true;
+				} else {
+					compile(COND_PRED(clause), false);
+					size_t next = emitJump(OP_JUMP_IF_FALSE);
+					compileSeq(COND_CONSEQUENCE(clause), tail);
+					if (!tail)
+						ends.push_back(emitJump(OP_JUMP));
+					patch(next);
+				}
+			}
+			if (!hasElse) {
+				emit(OP_CONST, addConst(VAR_VOID));
+				ret(tail);
+			}
+			for (size_t end : ends)
+				patch(end);
+		}
+
+		// Compile and/or, jump out with short value when test matches
+		void compileLogic(const Variable& exps, int test, const Variable& shortVal, const Variable& fullVal, bool tail)
+		{
+			vector<size_t> shorts;
+			for (const Variable* it = &exps; !it->isNull(); it = &it->cdr()) {
+				compile(it->car(), false);
+				shorts.push_back(emitJump(test));
+			}
+			emit(OP_CONST, addConst(fullVal));
+			size_t end = emitJump(OP_JUMP);
+			for (size_t pos : shorts)
+				patch(pos);
+			emit(OP_CONST, addConst(shortVal));
+			patch(end);
+			ret(tail);
+		}
+
+		void compileLet(const Variable& expr, bool tail)
+		{
+			int count = 0;
+			for (const Variable* it = &LET_BINDINGS(expr); !it->isNull(); it = &it->cdr(), count++)
+				compile(BINDING_VAL(it->car()), false);
+			fn.layouts.push_back(resolver.enterLet(LET_BINDINGS(expr), LET_BODY(expr)));
+			emit(OP_ENTER, fn.layouts.size() - 1, count);
+			compileSeq(LET_BODY(expr), tail);
+			resolver.leave();
+			if (!tail)
+				emit(OP_LEAVE);
+		}
+
+		void compileApplication(const Variable& expr, bool tail)
+		{
+			compile(APPLICATION_NAME(expr), false);
+			int argc = 0;
+			for (const Variable* it = &APPLICATION_ARGS(expr); !it->isNull(); it = &it->cdr(), argc++)
+				compile(it->car(), false);
+			emit(tail ? OP_TAIL_CALL : OP_CALL, argc);
+		}
+
+	public:
+
+		Compiler(Function& fn, Resolver& resolver): fn(fn), resolver(resolver) {}
+
+		// Compile expression, code in tail position returns from function
+		void compile(const Variable& expr, bool tail)
+		{
+			#ifdef LOG
+			VERBOSE("compile",expr);
+			#endif
+			if (IS_SELF_EVALUATING(expr)) {
+				emit(OP_CONST, addConst(expr));
+				ret(tail);
+				return;
+			}
+			if (IS_VARIABLE(expr)) {
+				compileRef(expr);
+				ret(tail);
+				return;
+			}
+			switch (formOf(expr)) {
+				case FORM_QUOTE:
+					emit(OP_CONST, addConst(QUOTED(expr)));
+					ret(tail);
+					return;
+				case FORM_DEFINE:
+					if (IS_DEFINE_PROC(expr)) {
+						compileLambda(DEFINE_PROC_NAME(expr).toString(), DEFINE_PROC_ARGS(expr), DEFINE_PROC_BODY(expr));
+						compileDefine(DEFINE_PROC_NAME(expr));
+					} else {
+						compile(DEFINE_VAR_VAL(expr), false);
+						compileDefine(DEFINE_VAR_NAME(expr));
+					}
+					ret(tail);
+					return;
+				case FORM_ASSIGNMENT:
+					compile(ASSIGNMENT_VAL(expr), false);
+					compileSet(ASSIGNMENT_VAR(expr));
+					ret(tail);
+					return;
+				case FORM_SEQ:
+					compileSeq(SEQUENCE(expr), tail);
+					return;
+				case FORM_AND:
+					compileLogic(AND_ARGS(expr), OP_JUMP_IF_FALSE, VAR_FALSE, VAR_TRUE, tail);
+					return;
+				case FORM_OR:
+					compileLogic(OR_ARGS(expr), OP_JUMP_IF_TRUE, VAR_TRUE, VAR_FALSE, tail);
+					return;
+				case FORM_IF:
+					compileIf(expr, tail);
+					return;
+				case FORM_COND:
+					compileCond(expr, tail);
+					return;
+				case FORM_LAMBDA:
+					compileLambda("lambda expression", LAMBDA_ARGS(expr), LAMBDA_BODY(expr));
+					ret(tail);
+					return;
+				case FORM_LET:
+					compileLet(expr, tail);
+					return;
+				case FORM_APPLICATION:
+				case FORM_ELSE:
+					compileApplication(expr, tail);
+					return;
+				default:
+					throw Exception(string("compile: can't compile ") + expr.toString());
+			}
+		}
+	};
+
+	// Call frame
+	struct Frame
+	{
+		Variable proc;			// Procedure running, null for entry
+		const Function* fn;		// Code running
+		const int* pc;			// Next instruction
+		size_t base;			// Stack height on entry
+		Environment env;		// Innermost frame
+
+		Frame(Variable proc, const Function* fn, size_t base, Environment env):
+			proc(std::move(proc)), fn(fn), pc(fn->code.data()), base(base), env(std::move(env)) {}
+	};
+
+	// Optimization: value and frame stacks are shared by nested runs
+	vector<Variable> stack;
+	vector<Frame> frames;
+
+	// Get compiled function of procedure, null if not compiled by VM
+	const Function* compiledOf(const Variable& proc)
+	{
+		if (!proc.isComp())
+			return nullptr;
+		const Evaluator::Node& code = proc.getProcedureCode();
+		return typeid(code) == typeid(Function) ? static_cast<const Function*>(&code) : nullptr;
+	}
+
+	// Run function until entry frame returns
+	Variable run(const Function& entry, const Environment& env)
+	{
+		size_t stackBase = stack.size();
+		size_t frameBase = frames.size();
+		frames.emplace_back(VAR_NULL, &entry, stackBase, env);
+		try {
+			for (;;) {
+				Frame& frame = frames.back();
+				const Function& fn = *frame.fn;
+				int op = *frame.pc++;
+				switch (op) {
+					case OP_CONST:
+						stack.push_back(fn.consts[*frame.pc++]);
+						break;
+					case OP_LOCAL_REF: {
+						int depth = *frame.pc++;
+						stack.push_back(frame.env.lookupVariable(depth, *frame.pc++));
+						break;
+					}
+					case OP_GLOBAL_REF: {
+						Global& global = fn.globals[*frame.pc++];
+						if (!global.cell && !(global.cell = frame.env.findGlobal(global.var)))
+							stack.push_back(frame.env.lookupVariable(global.var));
+						else
+							stack.push_back(*global.cell);
+						break;
+					}
+					case OP_LOCAL_SET: {
+						int depth = *frame.pc++;
+						frame.env.assignVariable(depth, *frame.pc++, std::move(stack.back()));
+						stack.back() = VAR_VOID;
+						break;
+					}
+					case OP_GLOBAL_SET: {
+						Global& global = fn.globals[*frame.pc++];
+						if (!global.cell && !(global.cell = frame.env.findGlobal(global.var))) {
+							frame.env.assignVariable(global.var, std::move(stack.back()));
+						} else {
+							GarbageCollector::writeBarrier(*global.cell);
+							*global.cell = std::move(stack.back());
+						}
+						stack.back() = VAR_VOID;
+						break;
+					}
+					case OP_DEFINE:
+						frame.env.defineVariable(fn.consts[*frame.pc++], std::move(stack.back()));
+						stack.back() = VAR_VOID;
+						break;
+					case OP_POP:
+						stack.pop_back();
+						break;
+					case OP_JUMP:
+						frame.pc = fn.code.data() + *frame.pc;
+						break;
+					case OP_JUMP_IF_FALSE:
+					case OP_JUMP_IF_TRUE: {
+						int target = *frame.pc++;
+						bool test = IS_TRUE(stack.back()) == (op == OP_JUMP_IF_TRUE);
+						stack.pop_back();
+						if (test)
+							frame.pc = fn.code.data() + target;
+						break;
+					}
+					case OP_CLOSURE: {
+						const shared_ptr<const Function>& lambda = fn.functions[*frame.pc++];
+						stack.push_back(Variable(lambda->name, lambda->args, lambda->body, frame.env, lambda));
+						break;
+					}
+					case OP_ENTER: {
+						const shared_ptr<const Environment::Layout>& layout = fn.layouts[*frame.pc++];
+						int count = *frame.pc++;
+						Environment extendEnv = Environment(layout, stack.data() + stack.size() - count, count, frame.env);
+						stack.resize(stack.size() - count);
+						frame.env = std::move(extendEnv);
+						break;
+					}
+					case OP_LEAVE:
+						frame.env = frame.env.getEncloseEnv();
+						break;
+					case OP_CALL:
+					case OP_TAIL_CALL: {
+						// Safe point, values in using are referenced by stacks
+						GarbageCollector::safePoint();
+						int argc = *frame.pc++;
+						size_t procPos = stack.size() - argc - 1;
+						Variable proc = std::move(stack[procPos]);
+						if (const Function* callee = compiledOf(proc)) {
+							// Bind arguments from stack, no list consed
+							Environment extendEnv = Environment(callee->layout, stack.data() + procPos + 1, min(argc, callee->argc), proc.getProcedureEnv());
+							stack.resize(procPos);
+							if (op == OP_TAIL_CALL) {
+								frame.proc = std::move(proc);
+								frame.fn = callee;
+								frame.pc = callee->code.data();
+								frame.env = std::move(extendEnv);
+							} else {
+								frames.emplace_back(std::move(proc), callee, procPos, std::move(extendEnv));
+							}
+							break;
+						}
+						Environment env = frame.env;
+						Variable val = VAR_VOID;
+						if (proc.isPrim()) {
+							// Optimization: primitives take arguments in place on stack
+							try {
+								val = proc(argc, stack.data() + procPos + 1, env);
+							} catch (Exception e) {
+								e.addTrace(proc.toString());
+								throw e;
+							}
+						} else {
+							// Evaluator procedures take argument list
+							Variable args = VAR_NULL;
+							for (size_t i = stack.size(); i > procPos + 1; i--)
+								args = Variable(std::move(stack[i - 1]), std::move(args));
+							val = Evaluator::apply(proc, args, env);
+						}
+						stack.resize(procPos);
+						stack.push_back(std::move(val));
+						if (op == OP_CALL)
+							break;
+					}
+					// Fall through for tail call
+					case OP_RETURN: {
+						Variable val = std::move(stack.back());
+						stack.resize(frames.back().base);
+						frames.pop_back();
+						if (frames.size() == frameBase)
+							return val;
+						stack.push_back(std::move(val));
+						break;
+					}
+					default:
+						throw Exception("vm: bad instruction");
+				}
+			}
+		} catch (Exception e) {
+			for (size_t i = frames.size(); i > frameBase; i--)
+				if (!frames[i - 1].proc.isNull())
+					e.addTrace(frames[i - 1].proc.toString());
+			stack.resize(stackBase);
+			frames.erase(frames.begin() + frameBase, frames.end());
+			throw e;
+		}
+	}
+
+}
+
+namespace VM {
+
+	// Run bytecode in environment binding arguments
+	Variable Function::eval(Environment &env) const
+	{
+		return run(*this, env);
+	}
+
+	// Compile expression into bytecode, locals are resolved in frames of environment
+	shared_ptr<const Function> compile(const Variable &expr, const Environment &env)
+	{
+		auto fn = make_shared<Function>();
+		fn->name = "top level";
+		fn->body = expr;
+		Resolver resolver = Resolver(env);
+		Compiler(*fn, resolver).compile(expr, true);
+		return fn;
+	}
+
+	// Compile and run expression
+	Variable eval(const Variable &expr, Environment &env)
+	{
+		return compile(expr, env)->eval(env);
+	}
+
+}
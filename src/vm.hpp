@@ -0,0 +1,72 @@
+//
+// Scheme Bytecode Virtual Machine
+//
+// Author: Zhang Zhenghao (zhangzhenghao@hotmail.com)
+//
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include "variable.hpp"
+#include "evaluator.hpp"
+
+namespace VM {
+
+	// Instruction set, operands follow opcode in code
+	enum Opcode {
+		OP_CONST,			// const index
+		OP_LOCAL_REF,		// depth, slot
+		OP_GLOBAL_REF,		// global index
+		OP_LOCAL_SET,		// depth, slot
+		OP_GLOBAL_SET,		// global index
+		OP_DEFINE,			// const index of symbol
+		OP_POP,
+		OP_JUMP,			// target
+		OP_JUMP_IF_FALSE,	// target
+		OP_JUMP_IF_TRUE,	// target
+		OP_CLOSURE,			// function index
+		OP_CALL,			// argument count
+		OP_TAIL_CALL,		// argument count
+		OP_RETURN,
+		OP_ENTER,			// layout index, count
+		OP_LEAVE
+	};
+
+	// Global variable referenced by function, cell is cached once defined
+	struct Global
+	{
+		Variable var;
+		Variable* cell;
+		Global(const Variable& var): var(var), cell(nullptr) {}
+	};
+
+	// Compiled procedure, also executable as evaluator procedure body
+	class Function: public Evaluator::Body
+	{
+	public:
+
+		// Procedure information
+		std::string name;
+		Variable args, body;
+
+		// Bytecode, constant pool, nested functions and layouts of let frames
+		std::vector<int> code;
+		std::vector<Variable> consts;
+		std::vector<std::shared_ptr<const Function>> functions;
+		std::vector<std::shared_ptr<const Environment::Layout>> layouts;
+
+		// Optimization: inline caches of global variables
+		mutable std::vector<Global> globals;
+
+		// Run bytecode in environment binding arguments
+		Variable eval(Environment &env) const override;
+	};
+
+	// Compile expression into bytecode, locals are resolved in frames of environment
+	std::shared_ptr<const Function> compile(const Variable &exp, const Environment &env);
+
+	// Compile and run expression
+	Variable eval(const Variable &exp, Environment &env);
+
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/python3
+
+# 
+# Test of fasl cache
+# 
+# Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
+# 
+import os
+import subprocess
+import sys
+import tempfile
+
+# Config
+EXECUTE		= ['../bin/main'] + sys.argv[1:]
+SOURCE		= '(define (square x) (* x x))\n(display (square 12))\n(newline)\n(display \'(1 2/3 "four" 5.5))\n(newline)\n'
+CHANGED		= SOURCE.replace('12', '13')
+DEPTH		= 200000
+
+# Run script and return its exit status and output
+def run(path):
+	result = subprocess.run(EXECUTE + [path], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	return result.returncode, result.stdout
+
+def inode(path):
+	return os.stat(path).st_ino
+
+total = 0
+accepted = 0
+
+def check(name, passed):
+	global total, accepted
+	total += 1
+	if passed:
+		accepted += 1
+		print('accepted\t' + name)
+	else:
+		print('error\t' + name)
+
+with tempfile.TemporaryDirectory() as directory:
+	script = os.path.join(directory, 'square.scm')
+	cache = os.path.join(directory, 'square.fasl')
+	with open(script, 'w') as file:
+		file.write(SOURCE)
+	expected = run(script)
+	check('cache written', os.path.exists(cache))
+
+	# Cache hit: output is unchanged and cache isn't rewritten
+	written = inode(cache)
+	check('cache hit', run(script) == expected and inode(cache) == written)
+
+	# Stale hash: changed source is read and cache is rewritten
+	with open(script, 'w') as file:
+		file.write(CHANGED)
+	status, output = run(script)
+	check('stale hash', status == 0 and b'169' in output and inode(cache) != written)
+
+	# Corrupt cache: every form still runs and cache is rewritten
+	with open(script, 'w') as file:
+		file.write(SOURCE)
+	run(script)
+	with open(cache, 'rb') as file:
+		data = file.read()
+	for cut in [1, len(data) // 2]:
+		with open(cache, 'wb') as file:
+			file.write(data[:-cut])
+		damaged = inode(cache)
+		check('truncated cache by {:d} bytes'.format(cut), run(script) == expected and inode(cache) != damaged)
+	with open(cache, 'wb') as file:
+		file.write(data[:-1] + bytes([0xff]))
+	damaged = inode(cache)
+	check('bad tag in cache', run(script) == expected and inode(cache) != damaged)
+
+	# Deeply nested datum is written and loaded without overflow
+	with open(script, 'w') as file:
+		file.write('(define x (quote ' + '(' * DEPTH + '1' + ')' * DEPTH + '))\n(display (pair? x))\n')
+	status, output = run(script)
+	written = inode(cache)
+	check('deep datum written', status == 0 and output == b'#t')
+	check('deep datum loaded', run(script) == (0, b'#t') and inode(cache) == written)
+
+	# Source with syntax error isn't cached
+	os.remove(cache)
+	with open(script, 'w') as file:
+		file.write(SOURCE + '(display "x"))\n')
+	run(script)
+	check('syntax error not cached', not os.path.exists(cache))
+
+print('{:d}/{:d} passed'.format(accepted, total))
+sys.exit(0 if accepted == total else 1)
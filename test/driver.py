@@ -6,12 +6,21 @@
 # Author: ZhangZhenghao (zhangzhenghao@hotmail.com)
 # 
 import os
+import sys
 import time
 
 # Config
-EXECUTE		= '../bin/main'
+EXECUTE		= ' '.join(['../bin/main'] + sys.argv[1:])
 PATH		= os.path.dirname(os.path.realpath(__file__))
 
+# Extra arguments of a test are given by a line "; args: ..." in it
+def test_args(path):
+	with open(path) as file:
+		for line in file:
+			if line.startswith('; args:'):
+				return ' ' + line[len('; args:'):].strip()
+	return ''
+
 start_time_total = time.time()
 total = 0
 accepted = 0
@@ -20,7 +29,7 @@ for file in files:
 	if file.endswith('.scm'):
 		total += 1
 		start_time = time.time()
-		result = os.system(EXECUTE + ' < ' + PATH + '/' + file + ' > /dev/null')
+		result = os.system(EXECUTE + test_args(PATH + '/' + file) + ' < ' + PATH + '/' + file + ' > /dev/null')
 		if result == 0:
 			accepted += 1
 			print('accepted', end='')
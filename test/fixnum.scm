@@ -0,0 +1,41 @@
+; Fixnum Overflow and Promotion
+
+(define max-fixnum 9223372036854775807)
+(define min-fixnum (- (- max-fixnum) 1))
+
+(define (fact n)
+  (if (= n 0)
+      1
+      (* n (fact (- n 1)))))
+
+(assert= (number->string (+ max-fixnum 1)) "9223372036854775808")
+(assert= (number->string (- min-fixnum 1)) "-9223372036854775809")
+(assert= (number->string (- min-fixnum)) "9223372036854775808")
+(assert= (number->string (quotient min-fixnum -1)) "9223372036854775808")
+(assert= (number->string (* 4294967296 4294967296)) "18446744073709551616")
+(assert= (- (+ max-fixnum 1) 1) max-fixnum)
+(assert= (quotient (fact 25) (fact 24)) 25)
+(assert= (remainder (fact 25) 7) 0)
+(assert= (remainder 17 -5) 2)
+(assert= (/ 6 3) 2)
+(assert= (number->string (/ 6 4)) "3/2")
+(assert (< max-fixnum (+ max-fixnum 1)))
+(assert (even? (+ max-fixnum 1)))
+
+; Literals are parsed into fixnums unless they overflow machine word
+(assert= (number->string -9223372036854775808) "-9223372036854775808")
+(assert= (number->string 9223372036854775808) "9223372036854775808")
+(assert= (number->string -9223372036854775809) "-9223372036854775809")
+(assert= -9223372036854775808 min-fixnum)
+(assert= (number->string 4/2) "2")
+(assert= (number->string 6/4) "3/2")
+(assert= (number->string -6/4) "-3/2")
+(assert= (number->string 18446744073709551616/4294967296) "4294967296")
+(assert= (+ 1/3 2/3) 1)
+(assert= 0/5 0)
+(assert= 2.5e1 25.0)
+
+; Literal with zero denominator is reported as syntax error instead of aborting
+1/0
+-18446744073709551616/00
+(assert= 3/1 3)
@@ -0,0 +1,54 @@
+; Garbage Collection of Large Data
+
+(define (build i acc)
+  (if (= i 0)
+      acc
+      (build (- i 1) (cons i acc))))
+
+(define (nest i acc)
+  (if (= i 0)
+      acc
+      (nest (- i 1) (list acc))))
+
+; Long cdr-chain and deep car-chain survive collections
+(define big (build 300000 '()))
+(define deep (nest 100000 '()))
+(assert= (length big) 300000)
+(assert= (car big) 1)
+
+; Cycles created inside one long-running call are collected
+(define (churn n)
+  (define (make)
+    (define (self) self)
+    (let ((p (list 1 2 3)))
+      (set-cdr! (cdr (cdr p)) p)
+      (list self p)))
+  (define (loop i keep)
+    (if (= i 0)
+        keep
+        (loop (- i 1) (if (= (remainder i 1000) 0) (cons (make) keep) (begin (make) keep)))))
+  (loop n '()))
+(define kept (churn 20000))
+(assert= (length kept) 20)
+(assert= (car (cdr (cdr (cdr (car (cdr (car kept))))))) 1)
+
+; Objects stored into quoted code survive collections
+(define (literal n)
+  (let ((x '(1 2)))
+    (set-car! x (list n n))
+    x))
+(define (mutate n)
+  (if (= n 0)
+      (literal 7)
+      (begin (literal n) (build 100 '()) (mutate (- n 1)))))
+(mutate 2000)
+(build 300000 '())
+(assert= (car (car (literal 8))) 8)
+(assert= (car (cdr (mutate 0))) 2)
+
+; Symbols dropped from code are interned again as the same symbol
+(define sym 'interned)
+(define (drop n) (if (= n 0) 0 (begin (list 'dropped n) (drop (- n 1)))))
+(drop 1000)
+(assert (eq? sym 'interned))
+(assert (eq? (car (list 'dropped)) 'dropped))
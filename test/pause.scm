@@ -0,0 +1,23 @@
+; Incremental Collection of Garbage Promoted Inside One Call
+; args: --gc-pause 200
+
+(define (build i acc)
+  (if (= i 0)
+      acc
+      (build (- i 1) (cons i acc))))
+
+; Lists rebuilt inside one long-running call are promoted before they are dropped
+(define kept '())
+(define (churn n)
+  (if (= n 0)
+      0
+      (begin (set! kept (build 100000 '())) (churn (- n 1)))))
+(churn 20)
+
+; Full collection deferred from inside the call starts at top-level and reclaims them
+(define (settle n)
+  (if (or (= n 0) (< (heap-size) 1000000))
+      n
+      (begin (build 10 '()) (settle (- n 1)))))
+(settle 100000)
+(assert (< (heap-size) 1000000))
@@ -47,4 +47,11 @@
           (/ d g))))
 
 (print-rat 
- (add-rat one-third one-third))
\ No newline at end of file
+ (add-rat one-third one-third))
+
+; Rational is reduced by gcd of both numerator and denominator
+(assert= (gcd 12 18) 6)
+(assert= (gcd -4 6) 2)
+(assert= (gcd 7 0) 7)
+(assert= (car (add-rat one-third one-third)) 2)
+(assert= (cdr (add-rat one-third one-third)) 3)
\ No newline at end of file